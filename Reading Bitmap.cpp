@@ -1,35 +1,225 @@
 ﻿#include "bitmap.h"
+#include "batch.h"
+#include "profile.h"
+#include "thread_pool.h"
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
-#include <fstream>
-const char* file_path1 = "birdmap.bmp";
-const char* file_path2 = "rotate.bmp";
+#include <string>
 
-int main()
+static void usage()
 {
-	const int width = 32;
-	const int height = 32;
+	std::cout << "bitmap-reading [options] inputs..." << "\n"
+		<< "inputs are bitmaps, directories of them or patterns like scans/*.bmp" << "\n"
+		<< "operations, applied in the order given:" << "\n"
+		<< "  --rescale WxH        resample to W x H" << "\n"
+		<< "  --rotate DEGREES     rotate counterclockwise, the canvas grows to fit" << "\n"
+		<< "  --grayscale          replace every pixel by its luma" << "\n"
+		<< "  --kernel NAME        catmull_rom, mitchell, lanczos3 or box for the rescales after it" << "\n"
+		<< "  --filter NAME        nearest, bilinear or bicubic for the rotations after it" << "\n"
+		<< "options:" << "\n"
+		<< "  --output DIR         write the results into DIR instead of next to the inputs" << "\n"
+		<< "  --suffix TEXT        added to the file names, _out by default without --output" << "\n"
+		<< "  --threads N          worker threads of the compute stage, 0 = one per core" << "\n"
+		<< "  --depth N            bitmaps waiting between two pipeline stages, 1 or more, 2 by default" << "\n"
+		<< "  --profile            print the time of every operation at the end" << "\n"
+		<< "  --trace FILE         save a Chrome trace of the run" << "\n";
+}
 
+static bool parse_size(const char* text, int& width, int& height)
+{
+	char* end = nullptr;
+	width = (int)std::strtol(text, &end, 10);
+	if (end == text || (*end != 'x' && *end != 'X'))
+	{
+		return false;
+	}
+	const char* rest = end + 1;
+	height = (int)std::strtol(rest, &end, 10);
+	return end != rest && *end == '\0' && width > 0 && height > 0;
+}
+
+static bool parse_count(const char* text, int& count)
+{
+	char* end = nullptr;
+	const long value = std::strtol(text, &end, 10);
+	if (end == text || *end != '\0' || value < 1 || value > INT_MAX)
+	{
+		return false;
+	}
+	count = (int)value;
+	return true;
+}
+
+static bool parse_kernel(const std::string& name, resample_kernel& kernel)
+{
+	if (name == "catmull_rom")
+	{
+		kernel = resample_kernel::catmull_rom;
+	}
+	else if (name == "mitchell")
+	{
+		kernel = resample_kernel::mitchell;
+	}
+	else if (name == "lanczos3")
+	{
+		kernel = resample_kernel::lanczos3;
+	}
+	else if (name == "box")
+	{
+		kernel = resample_kernel::box;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+static bool parse_filter(const std::string& name, rotate_filter& filter)
+{
+	if (name == "nearest")
+	{
+		filter = rotate_filter::nearest;
+	}
+	else if (name == "bilinear")
+	{
+		filter = rotate_filter::bilinear;
+	}
+	else if (name == "bicubic")
+	{
+		filter = rotate_filter::bicubic;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
 	std::ios_base::sync_with_stdio(false);
-	std::cin.tie(NULL);
 
-	bitmap bitmap1(width, height, file_path1);
+	std::vector <operation> operations;
+	std::vector <std::string> arguments;
+	std::string output_dir, suffix, trace;
+	bool suffix_given = false, profile = false;
+	int depth = 2;
+	resample_kernel kernel = resample_kernel::catmull_rom;
+	rotate_filter filter = rotate_filter::nearest;
+
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const bool has_value = i + 1 < argc;
+		operation op;
 
-	//std::cout << "DEBUG";
-	bitmap1.read_file();
+		if (arg == "--grayscale")
+		{
+			op.kind = operation_kind::grayscale;
+			operations.push_back(op);
+		}
+		else if (arg == "--rescale" && has_value && parse_size(argv[i + 1], op.width, op.height))
+		{
+			op.kind = operation_kind::rescale;
+			op.kernel = kernel;
+			operations.push_back(op);
+			i++;
+		}
+		else if (arg == "--rotate" && has_value)
+		{
+			op.kind = operation_kind::rotate;
+			op.degree = std::atof(argv[++i]);
+			op.filter = filter;
+			operations.push_back(op);
+		}
+		else if (arg == "--kernel" && has_value && parse_kernel(argv[i + 1], kernel))
+		{
+			i++;
+		}
+		else if (arg == "--filter" && has_value && parse_filter(argv[i + 1], filter))
+		{
+			i++;
+		}
+		else if (arg == "--output" && has_value)
+		{
+			output_dir = argv[++i];
+		}
+		else if (arg == "--suffix" && has_value)
+		{
+			suffix = argv[++i];
+			suffix_given = true;
+		}
+		else if (arg == "--threads" && has_value)
+		{
+			thread_pool::set_thread_count(std::atoi(argv[++i]));
+		}
+		else if (arg == "--depth" && has_value && parse_count(argv[i + 1], depth))
+		{
+			i++;
+		}
+		else if (arg == "--profile")
+		{
+			profile = true;
+		}
+		else if (arg == "--trace" && has_value)
+		{
+			trace = argv[++i];
+		}
+		else if (arg == "--help" || arg == "-h")
+		{
+			usage();
+			return 0;
+		}
+		else if (arg.rfind("--", 0) == 0)
+		{
+			std::cout << "Bad option " << arg << "\n";
+			usage();
+			return 1;
+		}
+		else
+		{
+			arguments.push_back(arg);
+		}
+	}
 
-	/*double scale;
-	std::cin >> scale;
+	const std::vector <std::string> inputs = expand_inputs(arguments);
+	if (inputs.empty())
+	{
+		usage();
+		return 1;
+	}
 
-	int new_width = bitmap1.m_width * scale;
-	int new_height = bitmap1.m_height * scale;
-	//std::cout << new_height << new_width;*/
+	if (!output_dir.empty())
+	{
+		std::error_code error;
+		std::filesystem::create_directories(output_dir, error);
+	}
+	if (!suffix_given && output_dir.empty())
+	{
+		suffix = "_out"; // never overwrite the inputs
+	}
 
-	//bitmap rescaled_bitmap = bitmap1.rescale(1000, 1000);
-	//rescaled_bitmap.rotate(180.0);
-	//rescaled_bitmap.export_file("haha.bmp");
+	std::vector <batch_job> jobs;
+	for (const std::string& input : inputs)
+	{
+		jobs.push_back({ input, output_path(input, output_dir, suffix) });
+	}
 
-	//bitmap1.rotate(310);
-	//bitmap1.export_file("rotated.bmp");
+	profile_trace(!trace.empty());
+	const batch_report report = run_batch(jobs, operations, depth);
+	print_report(report);
 
-	bitmap1.grayscale();
-}
\ No newline at end of file
+	if (profile)
+	{
+		profile_report(std::cout);
+	}
+	if (!trace.empty() && !profile_write_trace(trace.c_str()))
+	{
+		std::cout << (BITMAP_PROFILE ? "File write not" : "Profiling is not compiled in, build with BITMAP_PROFILE=1") << "\n";
+	}
+	return report.failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// Kept out of the files that allocate, so the compiler never sees a free inlined next to a new.
+// Plain thread locals only, operator new runs before anything else is set up.
+static std::atomic <uint64_t> allocations(0);
+static thread_local uint64_t thread_allocations = 0;
+
+static void* counted_malloc(size_t size) noexcept
+{
+	thread_allocations++;
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size != 0 ? size : 1);
+}
+
+static void* counted_aligned_malloc(size_t size, std::align_val_t alignment) noexcept
+{
+	thread_allocations++;
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	const size_t align = static_cast<size_t>(alignment);
+	size = size != 0 ? size : 1;
+#ifdef _WIN32
+	return _aligned_malloc(size, align);
+#else
+	// aligned_alloc takes whole multiples of the alignment only
+	return std::aligned_alloc(align, (size + align - 1) / align * align);
+#endif
+}
+
+static void aligned_free(void* p) noexcept
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+void* operator new(size_t size)
+{
+	if (void* p = counted_malloc(size))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return counted_malloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment)
+{
+	if (void* p = counted_aligned_malloc(size, alignment))
+	{
+		return p;
+	}
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void* operator new(size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return counted_aligned_malloc(size, alignment);
+}
+
+void* operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept
+{
+	return counted_aligned_malloc(size, alignment);
+}
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete(void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	aligned_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t, const std::nothrow_t&) noexcept
+{
+	aligned_free(p);
+}
+
+uint64_t allocation_count()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+uint64_t thread_allocation_count()
+{
+	return thread_allocations;
+}
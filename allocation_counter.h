@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Allocations made so far. allocation_counter.cpp replaces the global operator new and
+// delete to count them, every form (array, nothrow, aligned) in one place. Only the programs
+// that link it in (the benchmarks and tests) pay for the counting, profiling builds compile
+// it into the library and report the same numbers through profile_allocations and the
+// scope timers.
+uint64_t allocation_count(); // the whole process
+uint64_t thread_allocation_count(); // the calling thread
@@ -0,0 +1,264 @@
+#include "batch.h"
+#include "profile.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+void apply_operations(bitmap& image, const std::vector <operation>& operations)
+{
+	lazy_bitmap chain(image);
+	for (const operation& op : operations)
+	{
+		chain.then(op);
+	}
+	image = chain.evaluate();
+}
+
+// Queue between two pipeline stages, push blocks while `capacity` items are waiting
+template <typename T>
+class bounded_queue
+{
+public:
+	explicit bounded_queue(size_t capacity) : m_capacity(std::max <size_t>(capacity, 1)) {}
+
+	void push(T item)
+	{
+		std::unique_lock <std::mutex> lock(m_mutex);
+		m_not_full.wait(lock, [this] { return m_items.size() < m_capacity; });
+		m_items.push_back(std::move(item));
+		m_not_empty.notify_one();
+	}
+
+	// false once the queue is closed and drained
+	bool pop(T& item)
+	{
+		std::unique_lock <std::mutex> lock(m_mutex);
+		m_not_empty.wait(lock, [this] { return !m_items.empty() || m_closed; });
+		if (m_items.empty())
+		{
+			return false;
+		}
+		item = std::move(m_items.front());
+		m_items.pop_front();
+		m_not_full.notify_one();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard <std::mutex> lock(m_mutex);
+		m_closed = true;
+		m_not_empty.notify_all();
+	}
+
+private:
+	const size_t m_capacity;
+	std::deque <T> m_items;
+	std::mutex m_mutex;
+	std::condition_variable m_not_full;
+	std::condition_variable m_not_empty;
+	bool m_closed = false;
+};
+
+// A bitmap on its way through the pipeline, image is null when reading it failed
+struct batch_item
+{
+	size_t job = 0;
+	std::unique_ptr <bitmap> image;
+};
+
+static double seconds_since(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static double file_megabytes(const std::string& path)
+{
+	std::error_code error;
+	const uintmax_t size = fs::file_size(path, error);
+	return error ? 0.0 : size / 1e6;
+}
+
+batch_report run_batch(const std::vector <batch_job>& jobs, const std::vector <operation>& operations, int depth)
+{
+	batch_report report;
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	bounded_queue <batch_item> read(depth);
+	bounded_queue <batch_item> processed(depth);
+
+	std::thread reader([&]
+		{
+			for (size_t i = 0; i < jobs.size(); i++)
+			{
+				const std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+				batch_item item;
+				item.job = i;
+				item.image = std::make_unique<bitmap>(0, 0, jobs[i].input.c_str());
+				{
+					PROFILE_SCOPE("batch read");
+					item.image->read_file();
+				}
+				if (item.image->m_width == 0 || item.image->m_height == 0)
+				{
+					item.image.reset();
+				}
+				else
+				{
+					report.megapixels_in += double(item.image->m_width) * item.image->m_height / 1e6;
+					report.megabytes_read += file_megabytes(jobs[i].input);
+				}
+				report.read_seconds += seconds_since(t);
+				read.push(std::move(item));
+			}
+			read.close();
+		});
+
+	std::thread writer([&]
+		{
+			batch_item item;
+			while (processed.pop(item))
+			{
+				report.files++;
+				if (item.image == nullptr)
+				{
+					report.failed++;
+					continue;
+				}
+				const std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+				const batch_job& job = jobs[item.job];
+				bool written;
+				{
+					PROFILE_SCOPE("batch write");
+					written = item.image->export_file(job.output.c_str());
+				}
+				if (written)
+				{
+					report.megabytes_written += file_megabytes(job.output);
+					report.megapixels_out += double(item.image->m_width) * item.image->m_height / 1e6;
+				}
+				else
+				{
+					report.failed++;
+				}
+				item.image.reset();
+				report.write_seconds += seconds_since(t);
+			}
+		});
+
+	// the compute stage runs here, the pool splits every operation over all cores
+	batch_item item;
+	while (read.pop(item))
+	{
+		if (item.image != nullptr)
+		{
+			const std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+			PROFILE_SCOPE("batch compute");
+			apply_operations(*item.image, operations);
+			report.compute_seconds += seconds_since(t);
+		}
+		processed.push(std::move(item));
+	}
+	processed.close();
+
+	reader.join();
+	writer.join();
+	report.seconds = seconds_since(start);
+	return report;
+}
+
+// * matches any run of characters, ? any single one
+static bool wildcard_match(const char* pattern, const char* name)
+{
+	if (*pattern == '\0')
+	{
+		return *name == '\0';
+	}
+	if (*pattern == '*')
+	{
+		return wildcard_match(pattern + 1, name) || (*name != '\0' && wildcard_match(pattern, name + 1));
+	}
+	return *name != '\0' && (*pattern == '?' || *pattern == *name) && wildcard_match(pattern + 1, name + 1);
+}
+
+static bool is_bitmap_name(const fs::path& path)
+{
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+	return extension == ".bmp";
+}
+
+std::vector <std::string> expand_inputs(const std::vector <std::string>& arguments)
+{
+	std::vector <std::string> inputs;
+	for (const std::string& argument : arguments)
+	{
+		const fs::path path(argument);
+		std::error_code error;
+		std::vector <std::string> found;
+
+		if (fs::is_directory(path, error))
+		{
+			for (const fs::directory_entry& entry : fs::directory_iterator(path, error))
+			{
+				if (entry.is_regular_file(error) && is_bitmap_name(entry.path()))
+				{
+					found.push_back(entry.path().string());
+				}
+			}
+		}
+		else if (argument.find_first_of("*?") != std::string::npos)
+		{
+			const std::string pattern = path.filename().string();
+			const fs::path directory = path.has_parent_path() ? path.parent_path() : fs::path(".");
+			for (const fs::directory_entry& entry : fs::directory_iterator(directory, error))
+			{
+				if (entry.is_regular_file(error) && wildcard_match(pattern.c_str(), entry.path().filename().string().c_str()))
+				{
+					found.push_back(path.has_parent_path() ? entry.path().string() : entry.path().filename().string());
+				}
+			}
+			if (found.empty())
+			{
+				std::cout << "No file matches " << argument << "\n";
+			}
+		}
+		else
+		{
+			found.push_back(argument);
+		}
+
+		// directory order is up to the file system, sorted runs are repeatable
+		std::sort(found.begin(), found.end());
+		inputs.insert(inputs.end(), found.begin(), found.end());
+	}
+	return inputs;
+}
+
+std::string output_path(const std::string& input, const std::string& output_dir, const std::string& suffix)
+{
+	const fs::path path(input);
+	const fs::path directory = output_dir.empty() ? path.parent_path() : fs::path(output_dir);
+	return (directory / (path.stem().string() + suffix + ".bmp")).string();
+}
+
+void print_report(const batch_report& report)
+{
+	const double seconds = std::max(report.seconds, 1e-9);
+	const std::ios_base::fmtflags flags = std::cout.flags();
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << report.files << " files, " << report.failed << " failed, " << report.seconds << " s" << "\n";
+	std::cout << report.files / seconds << " files/s, " << report.megapixels_in / seconds << " MP/s in, " << report.megapixels_out / seconds << " MP/s out" << "\n";
+	std::cout << report.megabytes_read / seconds << " MB/s read, " << report.megabytes_written / seconds << " MB/s written" << "\n";
+	std::cout << "busy: read " << report.read_seconds << " s, compute " << report.compute_seconds << " s, write " << report.write_seconds << " s" << "\n";
+	std::cout.flags(flags);
+}
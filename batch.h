@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "bitmap.h"
+#include "lazy.h"
+
+// Runs the chain on one bitmap in place, fused where lazy_bitmap can fuse it
+void apply_operations(bitmap& image, const std::vector <operation>& operations);
+
+struct batch_job
+{
+	std::string input;
+	std::string output;
+};
+
+// Totals of a batch, stage times are the busy time of each stage, so with the stages
+// overlapping their sum is larger than the wall time
+struct batch_report
+{
+	int files = 0;
+	int failed = 0;
+	double megapixels_in = 0.0;
+	double megapixels_out = 0.0;
+	double megabytes_read = 0.0;
+	double megabytes_written = 0.0;
+	double seconds = 0.0;
+	double read_seconds = 0.0;
+	double compute_seconds = 0.0;
+	double write_seconds = 0.0;
+};
+
+// Reads, processes and writes every job through a three stage pipeline: file n + 1 is read
+// while file n is processed and file n - 1 written. At most `depth` bitmaps wait between two
+// stages, so memory stays bounded however long the list is.
+batch_report run_batch(const std::vector <batch_job>& jobs, const std::vector <operation>& operations, int depth = 2);
+
+// Expands every argument into bitmap paths: directories into the .bmp files in them, names
+// with * or ? into the matching files of their directory, anything else stays as it is
+std::vector <std::string> expand_inputs(const std::vector <std::string>& arguments);
+
+// dir/name.bmp for an input, name.bmp gets `suffix` before the extension when written next to it
+std::string output_path(const std::string& input, const std::string& output_dir, const std::string& suffix);
+
+void print_report(const batch_report& report);
@@ -1,19 +1,16 @@
 #include "bitmap.h"
+#include "bmp_file.h"
+#include "thread_pool.h"
+#include "rotate.h"
+#include "stream.h"
+#include "profile.h"
 #include <cmath>
+#include <memory>
+#include <string>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
-
-template <typename T>
-T max(T a, T b)
-{
-	return (a > b) ? a : b;
-}
-template <typename T>
-T min(T a, T b)
-{
-	return (a > b) ? b : a;
-}
+#include <atomic>
 
 color3f::color3f()
 {
@@ -32,992 +29,529 @@ color3f::~color3f()
 {
 }
 
-bitmap::bitmap(int width, int height, const char* file_path)
+// variant alternatives are declared in the same order as pixel_format
+template <size_t I = 0>
+pixel_storage make_storage(pixel_format format, int width, int height)
+{
+	if constexpr (I + 1 < std::variant_size<pixel_storage>::value)
+	{
+		if (static_cast<size_t>(format) != I)
+		{
+			return make_storage<I + 1>(format, width, height);
+		}
+	}
+	return pixel_storage(std::in_place_index<I>, width, height);
+}
+
+bitmap::bitmap(int width, int height, const char* file_path, pixel_format format)
 {
 	m_width = width;
 	m_height = height;
 	path = file_path;
-	m_colors.resize(width * height);
+	m_pixels = make_storage(format, width, height);
+	touch();
 }
 
 bitmap::~bitmap()
 {
 }
 
-color3f bitmap::get_color(int x, int y) const
+bitmap::bitmap(const bitmap& other) : m_pixels(other.m_pixels), m_stamp(other.content_stamp())
 {
-	return m_colors[y * m_width + x];
+	path = other.path;
+	m_width = other.m_width;
+	m_height = other.m_height;
 }
 
-void bitmap::set_color(const color3f& color, int x, int y)
+bitmap::bitmap(bitmap&& other) noexcept : m_pixels(std::move(other.m_pixels)), m_stamp(other.m_stamp.load(std::memory_order_relaxed))
 {
-	m_colors[y * m_width + x].r = color.r;
-	m_colors[y * m_width + x].g = color.g;
-	m_colors[y * m_width + x].b = color.b;
+	path = other.path;
+	m_width = other.m_width;
+	m_height = other.m_height;
+	other.touch();
 }
 
-void bitmap::read_file()
+bitmap& bitmap::operator =(const bitmap& other)
 {
-	std::ifstream f;
-	f.open(path, std::ios::in | std::ios::binary);
-
-	if (!f.is_open())
-	{
-		std::cout << "File open not" << "\n";
-		return;
-	}
-
-	const int fileHeaderSize = 14;
-	const int informationHeaderSize = 40;
-
-	unsigned char fileHeader[fileHeaderSize];
-	f.read(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-
-	if (fileHeader[0] != 'B' || fileHeader[1] != 'M')
-	{
-		std::cout << "Bitmap the file is not" << "\n";
-		return;
-	}
-
-	unsigned char informationHeader[informationHeaderSize];
-	f.read(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-
-	int fileSize = fileHeader[2] + (fileHeader[3] << 8) + (fileHeader[4] << 16) + (fileHeader[5] << 24);
-	m_width = informationHeader[4] + (informationHeader[5] << 8) + (informationHeader[6] << 16) + (informationHeader[7] << 24);
-	m_height = informationHeader[8] + (informationHeader[9] << 8) + (informationHeader[10] << 16) + (informationHeader[11] << 24);
+	path = other.path;
+	m_width = other.m_width;
+	m_height = other.m_height;
+	m_pixels = other.m_pixels;
+	m_stamp.store(other.content_stamp(), std::memory_order_relaxed);
+	return *this;
+}
 
-	m_colors.resize(m_width * m_height);
+// takes the pixels and their stamp, the moved from bitmap gets a new stamp when next asked
+bitmap& bitmap::operator =(bitmap&& other) noexcept
+{
+	path = other.path;
+	m_width = other.m_width;
+	m_height = other.m_height;
+	m_pixels = std::move(other.m_pixels);
+	m_stamp.store(other.m_stamp.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	other.touch();
+	return *this;
+}
 
-	const int paddingAmount = ((4 - (m_width * 3) % 4) % 4);
+uint64_t bitmap::content_stamp() const
+{
+	static std::atomic <uint64_t> next_stamp(1);
 
-	for (int y = 0; y < m_height; y++)
+	uint64_t stamp = m_stamp.load(std::memory_order_relaxed);
+	if (stamp == 0)
 	{
-		for (int x = 0; x < m_width; x++)
+		// the first caller after a modification picks the stamp, everyone else reads that one
+		const uint64_t fresh = next_stamp.fetch_add(1, std::memory_order_relaxed);
+		if (m_stamp.compare_exchange_strong(stamp, fresh, std::memory_order_relaxed))
 		{
-			unsigned char color[3];
-			f.read(reinterpret_cast<char*>(color), 3);
-
-			m_colors[y * m_width + x].r = static_cast <double>(color[2]) / 255.0f;
-			m_colors[y * m_width + x].g = static_cast <double>(color[1]) / 255.0f;
-			m_colors[y * m_width + x].b = static_cast <double>(color[0]) / 255.0f;
+			stamp = fresh;
 		}
-		f.ignore(paddingAmount);
 	}
-
-	f.close();
+	return stamp;
 }
 
-void bitmap::export_file(const char* export_path) const
+color3f bitmap::get_color(int x, int y) const
 {
-	std::ofstream f;
-	f.open(export_path, std::ios::out | std::ios::binary);
-
-	if (!f.is_open())
-	{
-		std::cout << "File open not" << "\n";
-		return;
-	}
-
-	unsigned char bmpPad[] = { 0,0,0 };
-	const int paddingAmount = ((4 - (m_width * 3) % 4) % 4);
-
-	const int fileHeaderSize = 14;
-	const int informationHeaderSize = 40;
-	const int fileSize = fileHeaderSize + informationHeaderSize + m_width * m_width * 3 + paddingAmount * m_height;
-
-	unsigned char fileHeader[fileHeaderSize];
-
-	//File Type
-	fileHeader[0] = 'B';
-	fileHeader[1] = 'M';
-	//File size
-	fileHeader[2] = fileSize;
-	fileHeader[3] = fileSize >> 8;
-	fileHeader[4] = fileSize >> 16;
-	fileHeader[5] = fileSize >> 24;
-	//Reserved
-	fileHeader[6] = 0;
-	fileHeader[7] = 0;
-	fileHeader[8] = 0;
-	fileHeader[9] = 0;
-	//Pixel data offset
-	fileHeader[10] = fileHeaderSize + informationHeaderSize;
-	fileHeader[11] = 0;
-	fileHeader[12] = 0;
-	fileHeader[13] = 0;
-
-	unsigned char informationHeader[informationHeaderSize];
-
-	//Header size
-	informationHeader[0] = informationHeaderSize;
-	informationHeader[1] = 0;
-	informationHeader[2] = 0;
-	informationHeader[3] = 0;
-	//Image width
-	informationHeader[4] = m_width;
-	informationHeader[5] = m_width >> 8;
-	informationHeader[6] = m_width >> 16;
-	informationHeader[7] = m_width >> 24;
-	//Image height
-	informationHeader[8] = m_height;
-	informationHeader[9] = m_height >> 8;
-	informationHeader[10] = m_height >> 16;
-	informationHeader[11] = m_height >> 24;
-	//Planes
-	informationHeader[12] = 1;
-	informationHeader[13] = 0;
-	//Bits per pixel (RGB)
-	informationHeader[14] = 24;
-	informationHeader[15] = 0;
-	//Comperssion
-	informationHeader[16] = 0;
-	informationHeader[17] = 0;
-	informationHeader[18] = 0;
-	informationHeader[19] = 0;
-	//Image size (No compression)
-	informationHeader[20] = 0;
-	informationHeader[21] = 0;
-	informationHeader[22] = 0;
-	informationHeader[23] = 0;
-	//X pixels per meter (?)
-	informationHeader[24] = 0;
-	informationHeader[25] = 0;
-	informationHeader[26] = 0;
-	informationHeader[27] = 0;
-	//Y pixels per meter (?)
-	informationHeader[28] = 0;
-	informationHeader[29] = 0;
-	informationHeader[30] = 0;
-	informationHeader[31] = 0;
-	//Total colors (Color palette not used)
-	informationHeader[32] = 0;
-	informationHeader[33] = 0;
-	informationHeader[34] = 0;
-	informationHeader[35] = 0;
-	//Important colors (Ignore idk why?)
-	informationHeader[36] = 0;
-	informationHeader[37] = 0;
-	informationHeader[38] = 0;
-	informationHeader[39] = 0;
-
-	f.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	f.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-
-	for (int y = 0; y < m_height; y++)
-	{
-		for (int x = 0; x < m_width; x++)
+	return std::visit([x, y](const auto& pixels)
 		{
-			unsigned char r = static_cast<unsigned char> (get_color(x, y).r * 255.0f);
-			unsigned char g = static_cast<unsigned char> (get_color(x, y).g * 255.0f);
-			unsigned char b = static_cast<unsigned char> (get_color(x, y).b * 255.0f);
+			return color3f(pixels.get(x, y, 0), pixels.get(x, y, 1), pixels.get(x, y, 2));
+		}, m_pixels);
+}
 
-			unsigned char color[] = { b, g, r };
+void bitmap::set_color(const color3f& color, int x, int y)
+{
+	touch();
+	std::visit([&color, x, y](auto& pixels)
+		{
+			pixels.set(x, y, 0, color.r);
+			pixels.set(x, y, 1, color.g);
+			pixels.set(x, y, 2, color.b);
+		}, m_pixels);
+}
 
-			f.write(reinterpret_cast<char*>(color), 3);
-		}
+pixel_format bitmap::format() const
+{
+	return static_cast<pixel_format>(m_pixels.index());
+}
 
-		f.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
+void bitmap::set_format(pixel_format new_format)
+{
+	touch();
+	if (new_format == format())
+	{
+		return;
 	}
 
-	f.close();
-
-	std::cout << "Let there be file" << "\n";
+	pixel_storage converted = make_storage(new_format, m_width, m_height);
+	std::visit([](const auto& src, auto& dst) { convert_image(src, dst); }, m_pixels, converted);
+	m_pixels = std::move(converted);
 }
 
-matrix reversed_matrix_w(16, 16, { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-							0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-						   -3, 3, 0, 0,-2,-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-							2,-2, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-							0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
-							0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
-							0, 0, 0, 0, 0, 0, 0, 0,-3, 3, 0, 0,-2,-1, 0, 0,
-							0, 0, 0, 0, 0, 0, 0, 0, 2,-2, 0, 0, 1, 1, 0, 0,
-						   -3, 0, 3, 0, 0, 0, 0, 0,-2, 0,-1, 0, 0, 0, 0, 0,
-							0, 0, 0, 0,-3, 0, 3, 0, 0, 0, 0, 0,-2, 0,-1, 0,
-							9,-9,-9, 9, 6, 3,-6,-3, 6,-6, 3,-3, 4, 2, 2, 1,
-						   -6, 6, 6,-6,-3,-3, 3, 3,-4, 4,-2, 2,-2,-2,-1,-1,
-							2, 0,-2, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0,
-							0, 0, 0, 0, 2, 0,-2, 0, 0, 0, 0, 0, 1, 0, 1, 0,
-						   -6, 6, 6,-6,-4,-2, 4, 2,-3, 3,-3, 3,-2,-1,-2,-1,
-							4,-4,-4, 4, 2, 2,-2,-2, 2,-2, 2,-2, 1, 1, 1, 1 });
+pixel_storage& bitmap::storage()
+{
+	touch();
+	return m_pixels;
+}
 
-double bitmap::bicubic_interpolate(matrix& a, double y, double x)//tbc
+const pixel_storage& bitmap::storage() const
 {
-	a.resize(4, 4);
-	float interpolation_value = 0;
+	return m_pixels;
+}
 
-	for (int i = 0; i < 4; i++)
+void bitmap::read_file()
+{
+	PROFILE_SCOPE("read_file");
+	touch();
+	bmp_view view;
+	if (!view.open(path))
 	{
-		for (int j = 0; j < 4; j++)
-		{
-			interpolation_value += a(j, i) * pow(x, j) * pow(y, i);
-		}
+		return;
 	}
 
-	/*if (interpolation_value > 255.0)
-	{
-		interpolation_value = 255.0;
-	}
-	if (interpolation_value < 0.0)
-	{
-		interpolation_value = 0.0;
-	}*/
+	m_width = view.width();
+	m_height = view.height();
+
+	m_pixels = make_storage(format(), m_width, m_height);
 
-	return interpolation_value;
+	std::visit([&view, this](auto& pixels) { convert_bmp_rows(view, pixels, 0, m_height); }, m_pixels);
 }
 
-matrix bitmap::bicub_scaled_matrix(matrix& pixels, int y, int x)
+bool bitmap::export_file(const char* export_path) const
 {
-	if (y + 1 < pixels.columns() && x + 1 < pixels.rows())
+	PROFILE_SCOPE("export_file");
+	bmp_writer f;
+
+	if (!f.open(export_path, m_width, m_height))
 	{
-		//std::cout << pixels(x + 1, y + 1);
-		bool stop = true;
-		matrix coefficients(16, 1, {
-				pixels(x,y), //1
-				pixels(x + 1,y),	//2
-				pixels(x,y + 1),//3
-				pixels(x + 1,y + 1),	//4
-				y > 0 ? (pixels(x,y) - pixels(x,y - 1)) : 0,	//5
-				y > 0 ? (pixels(x + 1,y) - pixels(x + 1,y - 1)) : 0,	//6
-				pixels(x,y + 1) - pixels(x,y),	//7
-				pixels(x + 1,y + 1) - pixels(x + 1,y),//8
-				x > 0 ? (pixels(x,y) - pixels(x - 1,y)) : 0,	//9
-				pixels(x + 1,y) - pixels(x,y),	//10
-				x > 0 ? (pixels(x ,y + 1) - pixels(x - 1,y + 1)) : 0,	//11
-				pixels(x + 1,y + 1) - pixels(x,y + 1),	//12
-				y > 0 && x > 0 ? (pixels(x,y) - pixels(x - 1, y - 1)) : 0,	//13
-				y > 0 ? (pixels(x + 1,y) - pixels(x , y - 1)) : 0,	//14
-				x > 0 ? (pixels(x	,y + 1) - pixels(x - 1, y)) : 0,//15
-				pixels(x + 1,y + 1) - pixels(x, y) //16
-			});
-		bool stop2 = true;
-		matrix interpolate = reversed_matrix_w * coefficients;
-		return interpolate;
+		std::cout << "File open not" << "\n";
+		return false;
 	}
-	else if (y + 1 < pixels.columns())
-	{
-		matrix coefficients(16, 1, {
-				pixels(x - 1,y), //1
-				pixels(x ,y),	//2
-				pixels(x,y + 1),//3
-				pixels(x ,y + 1),	//4
-				y > 0 ? (pixels(x - 1,y) - pixels(x - 1,y - 1)) : 0,	//5
-				y > 0 ? (pixels(x ,y) - pixels(x ,y - 1)) : 0,	//6
-				pixels(x - 1,y + 1) - pixels(x - 1,y),	//7
-				pixels(x ,y + 1) - pixels(x ,y),//8
-				x > 0 ? (pixels(x - 1,y) - pixels(x - 2 ,y)) : 0,	//9
-				pixels(x ,y) - pixels(x - 1,y),	//10
-				x > 0 ? (pixels(x - 1 ,y + 1) - pixels(x - 2,y + 1)) : 0,	//11
-				pixels(x ,y + 1) - pixels(x - 1,y + 1),	//12
-				y > 0 && x > 0 ? (pixels(x - 1,y) - pixels(x - 2, y - 1)) : 0,	//13
-				y > 0 ? (pixels(x ,y) - pixels(x - 1 , y - 1)) : 0,	//14
-				x > 0 ? (pixels(x - 1	,y + 1) - pixels(x - 2, y)) : 0,//15
-				pixels(x ,y + 1) - pixels(x - 1, y) //16
-			});
 
-		matrix interpolate = reversed_matrix_w * coefficients;
-		return interpolate;
-	}
-	else
-	{
-		matrix coefficients(16, 1, {
-				pixels(x - 1,y - 1), //1
-				pixels(x ,y - 1),	//2
-				pixels(x,y),//3
-				pixels(x ,y),	//4
-				y > 0 && x > 0 ? (pixels(x - 1,y - 1) - pixels(x - 1,y - 2)) : 0,	//5
-				y > 0 ? (pixels(x ,y - 1) - pixels(x ,y - 2)) : 0,	//6
-				pixels(x - 1,y) - pixels(x - 1,y - 1),	//7
-				pixels(x ,y) - pixels(x ,y - 1),//8
-				x > 0 ? (pixels(x - 1,y - 1) - pixels(x - 2 ,y - 1)) : 0,	//9
-				pixels(x ,y - 1) - pixels(x - 1,y - 1),	//10
-				x > 0 ? (pixels(x - 1 ,y) - pixels(x - 2,y)) : 0,	//11
-				pixels(x ,y) - pixels(x - 1,y),	//12
-				y > 0 && x > 0 ? (pixels(x - 1,y - 1) - pixels(x - 2, y - 2)) : 0,	//13
-				y > 0 ? (pixels(x ,y - 1) - pixels(x - 1 , y - 2)) : 0,	//14
-				x > 0 ? (pixels(x - 1	,y) - pixels(x - 2, y - 1)) : 0,//15
-				pixels(x ,y) - pixels(x - 1, y - 1) //16
-			});
+	std::visit([&f, this](const auto& pixels)
+		{
+			for (int y = 0; y < m_height; y++)
+			{
+				encode_bmp_row(pixels, y, f.next_row());
+				f.push_row();
+			}
+		}, m_pixels);
 
-		matrix interpolate = reversed_matrix_w * coefficients;
-		return interpolate;
+	if (!f.close())
+	{
+		std::cout << "File write not" << "\n";
+		return false;
 	}
+	return true;
 }
 
-void bitmap::bayer_lens(std::vector <color3f>& pixels)
+// 0 - 255 colours of the three planes, the way mosaicking writes them out
+static void planes_to_pixels(const image<float, pixel_layout::planar>& rgb, std::vector <color3f>& pixels)
 {
-	std::vector <double> red_pixels;
-	std::vector <double> green_pixels;
-	std::vector <double> blue_pixels;
-
-	for (int y = 0; y < m_height; y++)
-	{
-		for (int x = 0; x < m_width; x++)
+	const int width = rgb.width();
+	pixels.resize(static_cast<size_t>(width) * rgb.height());
+	parallel_rows(rgb.height(), [&](int first_row, int last_row)
 		{
-			if (y % 2 == 0)
+			for (int y = first_row; y < last_row; y++)
 			{
-				green_pixels.push_back(get_color(x, y).g * 255.0);
-				if (x + 1 < m_width)
+				for (int x = 0; x < width; x++)
 				{
-					x++;
-					red_pixels.push_back(get_color(x, y).r * 255.0);
+					color3f& pixel = pixels[x + y * width];
+					pixel.r = std::clamp(rgb.row(y, 0)[x], 0.0f, 1.0f) * 255.0;
+					pixel.g = std::clamp(rgb.row(y, 1)[x], 0.0f, 1.0f) * 255.0;
+					pixel.b = std::clamp(rgb.row(y, 2)[x], 0.0f, 1.0f) * 255.0;
 				}
 			}
-			else
+		});
+}
+
+mosaic_image bitmap::sample_mosaic(const cfa_descriptor& cfa) const
+{
+	PROFILE_SCOPE("sample_mosaic");
+	mosaic_image mosaic(m_width, m_height, 16, cfa);
+	std::vector <uint16_t>& samples = std::get<std::vector <uint16_t>>(mosaic.samples());
+
+	parallel_rows(m_height, [&](int first_row, int last_row)
+		{
+			for (int y = first_row; y < last_row; y++)
 			{
-				blue_pixels.push_back(get_color(x, y).b * 255.0);
-				if (x + 1 < m_width)
-				{
-					x++;
-					green_pixels.push_back(get_color(x, y).g * 255.0);
-				}
-				else
+				uint16_t* row = samples.data() + static_cast<size_t>(y) * m_width;
+				for (int x = 0; x < m_width; x++)
 				{
-					if (m_width % 2 == 1)
-					{
-						//std::cout << "WLAZLO";
-						green_pixels.push_back(0.0);
-						break;
-					}
+					const color3f color = get_color(x, y);
+					const int c = cfa.channel(x, y);
+					row[x] = to_sample<uint16_t>(c == 0 ? color.r : (c == 1 ? color.g : color.b));
 				}
 			}
-		}
-	}
-
-	matrix red_filter(m_width / 2, m_height / 2, red_pixels);
-	matrix green_filter;
-	matrix blue_filter;
-	double red_scale_height = (double)m_height / (m_height / 2 - 1), red_scale_width = (double)m_width / (m_width / 2 - 1);
-	double green_scale_height_1, green_scale_width_1, green_scale_height_2, green_scale_width_2;
-	double blue_scale_height, blue_scale_width;
+		});
+	return mosaic;
+}
 
-	if (m_width % 2 == 1 && m_height % 2 == 1)
-	{
-		green_filter.set_values(green_pixels);
-		green_filter.resize(m_width / 2 + 1, m_height);
-		green_scale_height_1 = (double)m_height / (m_height - 1), green_scale_width_1 = (double)m_width / (m_width / 2 - 1);
-		green_scale_height_2 = (double)m_height / (m_height - 1), green_scale_width_2 = (double)m_width / (m_width / 2 - 2);
-		blue_filter.set_values(blue_pixels);
-		blue_filter.resize(m_width / 2 + 1, m_height / 2);
-		blue_scale_height = (double)m_height / (m_height / 2 - 1), blue_scale_width = (double)m_width / (m_width / 2 - 1);
-	}
-	else if (m_width % 2 == 0 && m_height % 2 == 1)
+bool bitmap::demosaic(const mosaic_image& mosaic, demosaic_mode mode, bool fixed_point)
+{
+	PROFILE_SCOPE("bitmap::demosaic");
+	image<uint8_t, pixel_layout::planar> bytes;
+	image<float, pixel_layout::planar> rgb;
+	const bool fixed = fixed_point && demosaic_fixed(mosaic, mode, bytes);
+	if (!fixed && !::demosaic(mosaic, mode, rgb))
 	{
-		green_filter.resize(m_width / 2, m_height);
-		green_filter.set_values(green_pixels);
-		green_scale_height_1 = m_height, green_scale_width_1 = m_width / (m_width / 2 - 1);
-		blue_filter.resize(m_width / 2, m_height / 2);
-		blue_filter.set_values(blue_pixels);
-		blue_scale_height = m_height / (m_height / 2 - 1), blue_scale_width = m_width / (m_width / 2 - 1);
+		return false;
 	}
-	else if (m_width % 2 == 1 && m_height % 2 == 0)
+
+	touch();
+	m_width = mosaic.width();
+	m_height = mosaic.height();
+	pixel_storage pixels = make_storage(format(), m_width, m_height);
+	if (fixed)
 	{
-		green_filter.resize(m_width / 2 + 1, m_height);
-		green_filter.set_values(green_pixels);
-		green_scale_height_1 = m_height, green_scale_width_1 = m_width / (m_width / 2 - 2);
-		blue_filter.resize(m_width / 2 + 1, m_height / 2);
-		blue_filter.set_values(blue_pixels);
-		blue_scale_height = m_height / (m_height / 2 - 1), blue_scale_width = m_width / (m_width / 2);
+		std::visit([&bytes](auto& dst) { convert_image(bytes, dst); }, pixels);
 	}
 	else
 	{
-		green_filter.resize(m_width / 2, m_height);
-		green_filter.set_values(green_pixels);
-		green_scale_height_1 = m_height / (m_height - 1), green_scale_width_1 = m_width / (m_width / 2 - 1);
-		blue_filter.resize(m_width / 2, m_height / 2);
-		blue_filter.set_values(blue_pixels);
-		blue_scale_height = m_height / (m_height / 2), blue_scale_width = m_width / (m_width / 2);
-	}
-
-	for (int i = 0; i < m_height; i++)
-	{
-		for (int j = 0; j < m_width; j++)
-		{
-			//std::cout << j << " " << i << "\n";
-			int i_red = (int)floor(i / red_scale_height), j_red = (int)floor(j / red_scale_width);
-			int i_green = (int)floor(i / green_scale_height_1), j_green = (int)floor(j / green_scale_width_1);
-			int i_blue = (int)floor(i / blue_scale_height), j_blue = (int)floor(j / blue_scale_width);
-
-			if (i % 2 == 0)
-			{
-				matrix temp_red = bicub_scaled_matrix(red_filter, i_red, j_red);
-				matrix temp_blue = bicub_scaled_matrix(blue_filter, i_blue, j_blue);
-				pixels[j + i * m_width].r = bicubic_interpolate(temp_red, (double)i / red_scale_height - i_red, (double)j / red_scale_width - j_red);
-				pixels[j + i * m_width].g = green_filter(j_green, i_green);
-				pixels[j + i * m_width].b = bicubic_interpolate(temp_blue, (double)i / blue_scale_height - i_blue, (double)j / blue_scale_width - j_blue);
-
-				if (j + 1 < m_width)
-				{
-					j++;
-					j_red = (int)floor(j / red_scale_width);
-					j_green = (int)floor(j / green_scale_width_1);
-					j_blue = (int)floor(j / blue_scale_width);
-					matrix temp_green = bicub_scaled_matrix(green_filter, i_green, j_green);
-					matrix temp_blue = bicub_scaled_matrix(blue_filter, i_blue, j_blue);
-					pixels[j + i * m_width].r = red_filter(j_red, i_red);
-					pixels[j + i * m_width].g = bicubic_interpolate(temp_red, (double)i / green_scale_height_1 - i_green, (double)j / green_scale_width_1 - j_green);
-					pixels[j + i * m_width].b = bicubic_interpolate(temp_blue, (double)i / blue_scale_height - i_blue, (double)j / blue_scale_width - j_blue);
-				}
-			}
-			else
-			{
-				j_green = (int)floor(j / green_scale_width_1);
-				matrix temp_red = bicub_scaled_matrix(red_filter, i_red, j_red);
-				matrix temp_green = bicub_scaled_matrix(green_filter, i_green, j_green);
-				pixels[j + i * m_width].r = bicubic_interpolate(temp_red, (double)i / red_scale_height - i_red, (double)j / red_scale_width - j_red);
-				pixels[j + i * m_width].g = bicubic_interpolate(temp_red, (double)i / green_scale_height_1 - i_green, (double)j / green_scale_width_1 - j_green);
-				pixels[j + i * m_width].b = blue_filter(j_blue, i_blue);
-				if (j + 1 < m_width)
-				{
-					j++;
-					j_green = (int)floor(j / green_scale_width_1);
-					j_red = (int)floor(j / red_scale_width);
-					j_blue = (int)floor(j / blue_scale_width);
-					matrix temp_red = bicub_scaled_matrix(red_filter, i_red, j_red);
-					matrix temp_blue = bicub_scaled_matrix(blue_filter, i_blue, j_blue);
-					pixels[j + i * m_width].r = bicubic_interpolate(temp_red, (double)i / red_scale_height - i_red, (double)j / red_scale_width - j_red);
-					pixels[j + i * m_width].g = green_filter(j_green, i_green);
-					pixels[j + i * m_width].b = bicubic_interpolate(temp_blue, (double)i / blue_scale_height - i_blue, (double)j / blue_scale_width - j_blue);
-				}
-			}
-		}
+		std::visit([&rgb](auto& dst) { convert_image(rgb, dst); }, pixels);
 	}
+	m_pixels = std::move(pixels);
+	return true;
 }
 
-bitmap bitmap::rescale(int new_width, int new_height)
+void bitmap::bayer_lens(std::vector <color3f>& pixels, demosaic_mode mode)
 {
-	double ratio_y = (double)new_height / (m_height - 1);
-	double ratio_x = (double)new_width / (m_width - 1);
+	PROFILE_SCOPE("bayer_lens");
+	// sample the image through a GRBG filter, even rows G R, odd rows B G
+	cfa_descriptor cfa;
+	cfa.layout = cfa_layout::bayer;
+	cfa.pattern = bayer_pattern::grbg;
 
-	bitmap rescaled(new_width, new_height, "rescaled.bmp");
-
-	std::vector <double> red_pixels;
-	std::vector <double> green_pixels;
-	std::vector <double> blue_pixels;
-
-	for (int i = 0; i < m_height; i++)
+	image<float, pixel_layout::planar> rgb;
+	if (!::demosaic(sample_mosaic(cfa), mode, rgb))
 	{
-		for (int j = 0; j < m_width; j++)
-		{
-			red_pixels.push_back(get_color(j, i).r);
-			green_pixels.push_back(get_color(j, i).g);
-			blue_pixels.push_back(get_color(j, i).b);
-		}
-	}
-
-	matrix red_filter(m_width, m_height, red_pixels);
-	matrix green_filter(m_width, m_height, green_pixels);
-	matrix blue_filter(m_width, m_height, blue_pixels);
-
-	color3f pixel;
-
-	for (int i = 0; i < new_height; i++)
-	{
-		for (int j = 0; j < new_width; j++)
-		{
-			if (i == 569 && j == 835)
-			{
-				std::cout << i << " " << j << "\n";
-				bool stop = true;
-			}
-
-			int orginal_i = (int)floor(i / ratio_y), orginal_j = (int)floor(j / ratio_x);
-			matrix temp_red = bicub_scaled_matrix(red_filter, orginal_i, orginal_j);
-			matrix temp_green = bicub_scaled_matrix(green_filter, orginal_i, orginal_j);
-			matrix temp_blue = bicub_scaled_matrix(blue_filter, orginal_i, orginal_j);
-			pixel.r = bicubic_interpolate(temp_red, (double)i / ratio_y - orginal_i, (double)j / ratio_x - orginal_j);
-			pixel.g = bicubic_interpolate(temp_green, (double)i / ratio_y - orginal_i, (double)j / ratio_x - orginal_j);
-			pixel.b = bicubic_interpolate(temp_blue, (double)i / ratio_y - orginal_i, (double)j / ratio_x - orginal_j);
-
-			rescaled.set_color(pixel, j, i);
-		}
+		pixels.clear();
+		return;
 	}
-	return rescaled;
+	planes_to_pixels(rgb, pixels);
 }
 
-void bitmap::resize(int new_width, int new_height)
+void bitmap::grayscale(luma_standard standard)
 {
-	m_width = new_width;
-	m_height = new_height;
-
-	m_colors.clear();
-	m_colors.resize(m_width * m_height);
+	PROFILE_SCOPE("grayscale");
+	touch();
+	std::visit([standard](auto& pixels) { ::grayscale(pixels, standard); }, m_pixels);
 }
 
-void bitmap::rotate(double degree)
+void bitmap::to_color_space(color_space space)
 {
-	std::ofstream logs("logs.txt");
-
-	degree *= 0.0174532925;
-	double sinx = sin(degree);
-	double cosx = cos(degree);
+	PROFILE_SCOPE("to_color_space");
+	touch();
+	std::visit([space](auto& pixels) { ::to_color_space(pixels, space); }, m_pixels);
+}
 
-	int x1 = -m_height * sinx;
-	int x2 = m_width * cosx - m_height * sinx;
-	int x3 = m_width * cosx;
-	int y1 = m_height * cosx;
-	int y2 = m_height * cosx + m_width * sinx;
-	int y3 = m_width * sinx;
+void bitmap::from_color_space(color_space space)
+{
+	PROFILE_SCOPE("from_color_space");
+	touch();
+	std::visit([space](auto& pixels) { ::from_color_space(pixels, space); }, m_pixels);
+}
 
-	int minx = min(0, min(x1, min(x2, x3)));
-	int miny = min(0, min(y1, min(y2, y3)));
-	int maxx = max(x1, max(x2, x3));
-	int maxy = max(y1, max(y2, y3));
+// The cache keeps the float planes rescale reads and the whole pyramids of thumbnails apart
+static uint64_t cache_key(uint64_t stamp, bool levels)
+{
+	return stamp * 2 + (levels ? 1 : 0);
+}
 
-	int new_width = maxx - minx;
-	int new_height = maxy - miny;
+static size_t float_plane_bytes(int width, int height)
+{
+	return static_cast<size_t>(width) * height * 3 * sizeof(float);
+}
 
-	// TBD fix issue with corners being black idk if possible
-	std::vector <color3f> rotated_image;
-	rotated_image.resize(new_height * new_width);
+bitmap bitmap::rescale(int new_width, int new_height, resample_kernel kernel, bool linear_light, bool fixed_point) const
+{
+	PROFILE_SCOPE("rescale");
+	bitmap rescaled(new_width, new_height, "rescaled.bmp", format());
 
-	for (int y = 0; y < new_height; y++)
+	// Q14 weights lose too much past 1/16, larger reductions are left to the pyramid
+	const bool fixed = fixed_point && !linear_light && (format() == pixel_format::rgb8 || format() == pixel_format::rgb8_planar)
+		&& m_width <= new_width * 16 && m_height <= new_height * 16;
+	if (fixed)
 	{
-		for (int x = 0; x < new_width; x++)
-		{
-			int original_x = ((x + minx) * cosx + (y + miny) * sinx);
-			int original_y = ((y + miny) * cosx - (x + minx) * sinx);
-
-			logs << x << " " << y << " |" << original_x << " " << original_y << "\n";
+		std::visit([kernel](const auto& src, auto& dst)
+			{
+				using S = typename std::decay_t<decltype(src)>::sample_type;
+				using D = typename std::decay_t<decltype(dst)>::sample_type;
+				if constexpr (std::is_same<S, uint8_t>::value && std::is_same<D, uint8_t>::value)
+				{
+					resample_image_fixed(src, dst, kernel);
+				}
+			}, m_pixels, rescaled.m_pixels);
+		return rescaled;
+	}
 
-			if (original_x >= 0 && original_x < m_width &&
-				original_y >= 0 && original_y < m_height//&&
-				//rotated_x + rotated_y * new_height < rotated_image.size()
-				)
+	// repeated rescales of the same pixels read cached float planes, the very values
+	// resample_image would load from the source, so the result is the same. Linear light
+	// decodes bytes through a table instead, it always starts from the source.
+	if (!linear_light)
+	{
+		std::shared_ptr <const image_pyramid> planes = pyramid_cache::global().get(cache_key(content_stamp(), false), float_plane_bytes(m_width, m_height), [this](image_pyramid& p)
 			{
-				rotated_image[x + y * new_width] = get_color(original_x, original_y);
-			}
+				std::visit([&p](const auto& pixels) { p.load(pixels); }, m_pixels);
+			});
+		if (planes != nullptr)
+		{
+			std::visit([&planes, kernel](auto& dst) { resample_image(planes->level(0), dst, kernel); }, rescaled.m_pixels);
+			return rescaled;
 		}
 	}
 
-	resize(new_width, new_height);
+	std::visit([kernel, linear_light](const auto& src, auto& dst) { resample_image(src, dst, kernel, linear_light); }, m_pixels, rescaled.m_pixels);
 
-	m_colors = rotated_image;
+	return rescaled;
 }
 
-void bitmap::fuji_lens(std::vector <color3f>& pixels)
+bitmap bitmap::rescale(int new_width, int new_height, interpolation method) const
 {
-	std::vector <double> red_pixels;
-	std::vector <double> green_pixels;
-	std::vector <double> blue_pixels;
-
-	pixels.clear();
-	pixels.resize(m_width * m_height);
+	PROFILE_SCOPE("interpolate");
+	switch (method)
+	{
+	case interpolation::nearest:
+		return rescale<nearest_policy>(new_width, new_height);
+	case interpolation::bilinear:
+		return rescale<bilinear_policy>(new_width, new_height);
+	case interpolation::biquadratic:
+		return rescale<biquadratic_policy>(new_width, new_height);
+	case interpolation::constrained_bicubic:
+		return rescale<constrained_bicubic_policy>(new_width, new_height);
+	default:
+		return rescale<bicubic_policy>(new_width, new_height);
+	}
+}
 
-	char filter_sample[6][6] =
+std::shared_ptr <const image_pyramid> bitmap::pyramid() const
+{
+	auto build = [this](image_pyramid& p)
 	{
-		{'G','B','R','G','R','B'},
-		{'R','G','G','B','G','G'},
-		{'B','G','G','R','G','G'},
-		{'G','R','B','G','B','R'},
-		{'B','G','G','R','G','G'},
-		{'R','G','G','B','G','G'}
+		std::visit([&p](const auto& pixels) { p.build(pixels); }, m_pixels);
 	};
 
-	std::vector <char> filter_image;
-
-	for (int y = 0; y < m_height; y++)
+	// the levels below the source add up to a third of it
+	const size_t bytes = float_plane_bytes(m_width, m_height) / 3 * 4;
+	std::shared_ptr <const image_pyramid> levels = pyramid_cache::global().get(cache_key(content_stamp(), true), bytes, build);
+	if (levels == nullptr)
 	{
-		for (int x = 0; x < m_width; x++)
-		{
-			filter_image.push_back(filter_sample[y % 6][x % 6]);
-		}
+		std::shared_ptr <image_pyramid> local = std::make_shared<image_pyramid>();
+		build(*local);
+		levels = local;
 	}
+	return levels;
+}
 
-	std::vector <std::vector <double>> green_map;
-	std::vector <std::vector <double>> red_map;
-	std::vector <std::vector <double>> blue_map;
+std::vector <bitmap> bitmap::thumbnails(const std::vector <std::pair <int, int>>& sizes, resample_kernel kernel) const
+{
+	PROFILE_SCOPE("thumbnails");
+	const std::shared_ptr <const image_pyramid> levels = pyramid();
 
-	for (int y = 0; y < m_height; y++)
+	std::vector <bitmap> result;
+	result.reserve(sizes.size());
+	for (const std::pair <int, int>& size : sizes)
 	{
-		for (int x = 0; x < m_width; x++)
-		{
-			if (filter_image[x + y * m_width] == 'G')
-			{
-				green_pixels.push_back(get_color(x, y).g * 255.0);
-				if ((y % 6 == 1 || y % 6 == 5) && x % 6 == 4)
-				{
-					red_pixels.push_back(0.0);
-					blue_pixels.push_back(0.0);
-				}
-				if ((y % 6 == 2 || y % 6 == 4) && x % 6 == 4)
-				{
-					blue_pixels.push_back(0.0);
-					red_pixels.push_back(0.0);
-				}
-			}
-			else if (filter_image[x + y * m_width] == 'R')
-			{
-				red_pixels.push_back(get_color(x, y).r * 255.0);
-				if (y % 6 == 0 && x % 6 == 2)
-				{
-					green_pixels.push_back(0.0);
-				}
-				if (y % 6 == 3 && x % 6 == 5)
-				{
-					green_pixels.push_back(0.0);
-				}
-			}
-			else
-			{
-				blue_pixels.push_back(get_color(x, y).b * 255.0);
-				if (y % 6 == 3 && x % 6 == 2)
-				{
-					green_pixels.push_back(0.0);
-				}
-				if (y % 6 == 0 && x % 6 == 5)
-				{
-					green_pixels.push_back(0.0);
-				}
-			}
-		}
-
-		red_map.push_back(red_pixels);
-		red_pixels.clear();
-		green_map.push_back(green_pixels);
-		green_pixels.clear();
-		blue_map.push_back(blue_pixels);
-		blue_pixels.clear();
+		result.emplace_back(size.first, size.second, "thumbnail.bmp", format());
+		std::visit([&levels, kernel](auto& dst) { levels->resample(dst, kernel); }, result.back().m_pixels);
 	}
+	return result;
+}
 
-	int green_width = ceil(m_width * 0.66666666);
-	int blue_width = m_width / 3 + (m_width % 6 >= 4 ? (1) : 0);
-	int red_width = m_width / 3 + (m_width % 6 >= 4 ? (1) : 0);
-
-	for (int i = 0; i < m_height; i++)
-	{
-		if (red_map[i].size() == red_width)
-		{
-			for (int j = 0; j < red_width; j++)
-			{
-				red_pixels.push_back(red_map[i][j]);
-			}
-		}
-		else
-		{
-			red_map[i].push_back(0.0);
-			for (int j = 0; j < red_width; j++)
-			{
-				red_pixels.push_back(red_map[i][j]);
-			}
-		}
-		if (green_map[i].size() == green_width)
-		{
-			for (int j = 0; j < green_width; j++)
-			{
-				green_pixels.push_back(green_map[i][j]);
-			}
-		}
-		else
-		{
-			green_map[i].push_back(0.0);
-			for (int j = 0; j < green_width; j++)
-			{
-				green_pixels.push_back(green_map[i][j]);
-			}
-		}
-		if (blue_map[i].size() == blue_width)
-		{
-			for (int j = 0; j < blue_width; j++)
-			{
-				blue_pixels.push_back(blue_map[i][j]);
-			}
-		}
-		else
-		{
-			blue_map[i].push_back(0.0);
-			for (int j = 0; j < blue_width; j++)
-			{
-				blue_pixels.push_back(blue_map[i][j]);
-			}
-		}
-	}
+void bitmap::resize(int new_width, int new_height)
+{
+	touch();
+	m_width = new_width;
+	m_height = new_height;
 
-	matrix red_broken_filter(red_width, m_height, red_pixels);
-	matrix green_broken_filter(green_width, m_height, green_pixels);
-	matrix blue_broken_filter(blue_width, m_height, blue_pixels);
+	m_pixels = make_storage(format(), m_width, m_height);
+}
 
-	for (int i = 0; i < m_height; i++)
+void bitmap::rotate(double degree, rotate_filter filter)
+{
+	PROFILE_SCOPE("rotate");
+	touch();
+	const int turns = right_angle_turns(degree);
+	if (turns == 0)
 	{
-		for (int j = 0; j < green_width; j++)
-		{
-			if (green_broken_filter(j, i) == 0.0)
-			{
-				matrix temp_green = bicub_scaled_matrix(green_broken_filter, i, j);
-				green_pixels[j + i * green_width] = bicubic_interpolate(temp_green, 1, 1);
-			}
-		}
+		return;
 	}
-	for (int i = 0; i < m_height; i++)
+
+	if (turns > 0)
 	{
-		for (int j = 0; j < red_width; j++)
-		{
-			if (red_broken_filter(j, i) == 0.0)
+		std::visit([this, turns](auto& pixels)
 			{
-				matrix temp_red = bicub_scaled_matrix(red_broken_filter, i, j);
-				red_pixels[j + i * red_width] = bicubic_interpolate(temp_red, 1, 1);
-			}
-		}
+				std::decay_t<decltype(pixels)> rotated;
+				rotate_right_angle(pixels, rotated, turns);
+				pixels = std::move(rotated);
+			}, m_pixels);
 	}
-
-	for (int i = 0; i < m_height; i++)
+	else
 	{
-		for (int j = 0; j < blue_width; j++)
-		{
-			if (blue_broken_filter(j, i) == 0.0)
-			{
-				matrix temp_blue = bicub_scaled_matrix(blue_broken_filter, i, j);
-				blue_pixels[j + i * blue_width] = bicubic_interpolate(temp_blue, 1, 1);
-			}
-		}
+		const rotation_frame frame = rotation_bounds(m_width, m_height, degree);
+		warp_options options;
+		options.filter = filter;
+		m_pixels = std::move(warp(affine_transform::rotation(frame), frame.width, frame.height, options).m_pixels);
 	}
 
-	matrix red_filter(red_width, m_height, red_pixels);
-	matrix green_filter(green_width, m_height, green_pixels);
-	matrix blue_filter(blue_width, m_height, blue_pixels);
-
-	double red_scale_height = m_height / (m_height - 1), red_scale_width = (double)m_width / (red_width - 1);
-	double green_scale_height = m_height / (m_height - 1), green_scale_width = (double)m_width / (green_width - 1);
-	double blue_scale_height = m_height / (m_height - 1), blue_scale_width = (double)m_width / (blue_width - 1);
-
-	for (int i = 0; i < m_height; i++)
-	{
-		for (int j = 0; j < m_width; j++)
+	std::visit([this](const auto& pixels)
 		{
-			int j_red = (int)floor(j / red_scale_width);
-			int j_green = (int)floor(j / green_scale_width);
-			int j_blue = (int)floor(j / blue_scale_width);
-
-			if (filter_image[j + i * m_width] == 'G')
-			{
-				matrix temp_red = bicub_scaled_matrix(red_filter, i, j_red);
-				matrix temp_blue = bicub_scaled_matrix(blue_filter, i, j_blue);
-				pixels[j + i * m_width].r = bicubic_interpolate(temp_red, 1, (double)j / red_scale_width - j_red);
-				pixels[j + i * m_width].g = green_filter(j_green, i);
-				pixels[j + i * m_width].b = bicubic_interpolate(temp_blue, 1, (double)j / blue_scale_width - j_blue);
-			}
-			else if (filter_image[j + i * m_width] == 'R')
-			{
-				matrix temp_green = bicub_scaled_matrix(green_filter, i, j_green);
-				matrix temp_blue = bicub_scaled_matrix(blue_filter, i, j_blue);
-				pixels[j + i * m_width].r = red_filter(j_red, i);
-				pixels[j + i * m_width].g = bicubic_interpolate(temp_green, 1, (double)j / green_scale_width - j_green);
-				pixels[j + i * m_width].b = bicubic_interpolate(temp_blue, 1, (double)j / blue_scale_width - j_blue);
-			}
-			else
-			{
-				matrix temp_red = bicub_scaled_matrix(red_filter, i, j_red);
-				matrix temp_green = bicub_scaled_matrix(green_filter, i, j_green);
-				pixels[j + i * m_width].r = bicubic_interpolate(temp_red, 1, (double)j / red_scale_width - j_red);
-				pixels[j + i * m_width].g = bicubic_interpolate(temp_green, 1, (double)j / green_scale_width - j_green);
-				pixels[j + i * m_width].b = blue_filter(j_blue, i);
-			}
-		}
-	}
+			m_width = pixels.width();
+			m_height = pixels.height();
+		}, m_pixels);
 }
 
-void bitmap::mosaicking(char interpolation_type)
+bitmap bitmap::warp(const perspective_transform& to_source, int new_width, int new_height, const warp_options& options) const
 {
-	std::vector <color3f> pixels;
+	PROFILE_SCOPE("warp");
+	bitmap warped(new_width, new_height, "warped.bmp", format());
+	std::visit([&to_source, &options](const auto& src, auto& dst) { warp_image(src, dst, to_source, options); }, m_pixels, warped.m_pixels);
+	return warped;
+}
 
-	std::ofstream bayer_map("bayer.bmp");
-	std::ofstream red_bayer_map("red_bayer_map.bmp");
-	std::ofstream green_bayer_map("green_bayer_map.bmp");
-	std::ofstream blue_bayer_map("blue_bayer_map.bmp");
+void bitmap::fuji_lens(std::vector <color3f>& pixels)
+{
+	PROFILE_SCOPE("fuji_lens");
+	cfa_descriptor cfa;
+	cfa.layout = cfa_layout::xtrans;
 
-	std::ofstream fuji_map("fuji.bmp");
-	std::ofstream red_fuji_map("red_fuji_map.bmp");
-	std::ofstream green_fuji_map("green_fuji_map.bmp");
-	std::ofstream blue_fuji_map("blue_fuji_map.bmp");
+	image<float, pixel_layout::planar> rgb;
+	::demosaic(sample_mosaic(cfa), demosaic_mode::malvar, rgb);
+	planes_to_pixels(rgb, pixels);
+}
 
-	if (!fuji_map.is_open())
+// bayer.bmp and friends for one lens: the full colour result, one file per channel,
+// the difference to the source and the text dump, each written on its own thread
+static bool write_lens_outputs(const band_image& result, const band_image& source, const char* lens, const mosaic_outputs& outputs)
+{
+	const size_t buffer_size = 8 << 20;
+	const std::string name = lens;
+	const std::string full = name + ".bmp";
+	const std::string red = "red_" + name + "_map.bmp";
+	const std::string green = "green_" + name + "_map.bmp";
+	const std::string blue = "blue_" + name + "_map.bmp";
+	const std::string difference = name + "_difference.bmp";
+	const std::string dump = name + "_logs.txt";
+
+	// sinks nobody asked for are never constructed
+	std::vector <std::unique_ptr <band_sink>> owned;
+	std::vector <band_sink*> branches;
+	auto add = [&owned](band_sink* sink) { owned.emplace_back(sink); return sink; };
+	auto writer = [&](const std::string& path) { return add(new async_sink(*add(new bmp_band_writer(path.c_str(), buffer_size)))); };
+
+	if (outputs.full)
+	{
+		branches.push_back(writer(full));
+	}
+	if (outputs.channels)
 	{
-		std::cout << "File open not" << "\n";
-		return;
+		branches.push_back(add(new split_stage(*writer(red), *writer(green), *writer(blue))));
 	}
-
-	unsigned char bmpPad[3] = { 0,0,0 };
-	const int paddingAmount = ((4 - (m_width * 3) % 4) % 4);
-
-	const int fileHeaderSize = 14;
-	const int informationHeaderSize = 40;
-	const int fileSize = fileHeaderSize + informationHeaderSize + m_width * m_width * 3 + paddingAmount * m_height;
-
-	unsigned char fileHeader[fileHeaderSize];
-
-	//File Type
-	fileHeader[0] = 'B';
-	fileHeader[1] = 'M';
-	//File size
-	fileHeader[2] = fileSize;
-	fileHeader[3] = fileSize >> 8;
-	fileHeader[4] = fileSize >> 16;
-	fileHeader[5] = fileSize >> 24;
-	//Reserved
-	fileHeader[6] = 0;
-	fileHeader[7] = 0;
-	fileHeader[8] = 0;
-	fileHeader[9] = 0;
-	//Pixel data offset
-	fileHeader[10] = fileHeaderSize + informationHeaderSize;
-	fileHeader[11] = 0;
-	fileHeader[12] = 0;
-	fileHeader[13] = 0;
-
-	unsigned char informationHeader[informationHeaderSize];
-
-	//Header size
-	informationHeader[0] = informationHeaderSize;
-	informationHeader[1] = 0;
-	informationHeader[2] = 0;
-	informationHeader[3] = 0;
-	//Image width
-	informationHeader[4] = m_width;
-	informationHeader[5] = m_width >> 8;
-	informationHeader[6] = m_width >> 16;
-	informationHeader[7] = m_width >> 24;
-	//Image height
-	informationHeader[8] = m_height;
-	informationHeader[9] = m_height >> 8;
-	informationHeader[10] = m_height >> 16;
-	informationHeader[11] = m_height >> 24;
-	//Planes
-	informationHeader[12] = 1;
-	informationHeader[13] = 0;
-	//Bits per pixel (RGB)
-	informationHeader[14] = 24;
-	informationHeader[15] = 0;
-	//Comperssion
-	informationHeader[16] = 0;
-	informationHeader[17] = 0;
-	informationHeader[18] = 0;
-	informationHeader[19] = 0;
-	//Image size (No compression)
-	informationHeader[20] = 0;
-	informationHeader[21] = 0;
-	informationHeader[22] = 0;
-	informationHeader[23] = 0;
-	//X pixels per meter (?)
-	informationHeader[24] = 0;
-	informationHeader[25] = 0;
-	informationHeader[26] = 0;
-	informationHeader[27] = 0;
-	//Y pixels per meter (?)
-	informationHeader[28] = 0;
-	informationHeader[29] = 0;
-	informationHeader[30] = 0;
-	informationHeader[31] = 0;
-	//Total colors (Color palette not used)
-	informationHeader[32] = 0;
-	informationHeader[33] = 0;
-	informationHeader[34] = 0;
-	informationHeader[35] = 0;
-	//Important colors (Ignore idk why?)
-	informationHeader[36] = 0;
-	informationHeader[37] = 0;
-	informationHeader[38] = 0;
-	informationHeader[39] = 0;
-
-	bayer_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	bayer_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	red_bayer_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	red_bayer_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	green_bayer_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	green_bayer_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	blue_bayer_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	blue_bayer_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-
-	std::ofstream diffrence("diffrence.bmp");
-
-	diffrence.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	diffrence.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	fuji_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	fuji_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	red_fuji_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	red_fuji_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	green_fuji_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	green_fuji_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-	blue_fuji_map.write(reinterpret_cast<char*>(fileHeader), fileHeaderSize);
-	blue_fuji_map.write(reinterpret_cast<char*>(informationHeader), informationHeaderSize);
-
-	pixels.resize(m_width * m_height);
-
-	bayer_lens(pixels);
-
-	std::ofstream blue_logs("test_logs.txt");
-
-	for (int i = 0; i < pixels.size(); i++)
+	if (outputs.difference)
 	{
-		blue_logs << pixels[i].b << " " << pixels[i].g << " " << pixels[i].b << "\n";
+		branches.push_back(add(new difference_stage(*writer(difference), source)));
 	}
-
-	blue_logs.close();
-
-	for (int y = 0; y < m_height; y++)
+	if (outputs.text_dump)
 	{
-		for (int x = 0; x < m_width; x++)
-		{
-			unsigned char r = static_cast<unsigned char> (pixels[y * m_width + x].r);
-			unsigned char g = static_cast<unsigned char> (pixels[y * m_width + x].g);
-			unsigned char b = static_cast<unsigned char> (pixels[y * m_width + x].b);
-
-			unsigned char color[] = { b, g, r };
-			unsigned char color_red[] = { 0, 0, r };
-			unsigned char color_green[] = { 0, g, 0 };
-			unsigned char color_blue[] = { b, 0, 0 };
-
-			bayer_map.write(reinterpret_cast<char*>(color), 3);
-			red_bayer_map.write(reinterpret_cast<char*>(color_red), 3);
-			green_bayer_map.write(reinterpret_cast<char*>(color_green), 3);
-			blue_bayer_map.write(reinterpret_cast<char*>(color_blue), 3);
-		}
-
-		bayer_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
-		red_bayer_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
-		green_bayer_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
-		blue_bayer_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
+		branches.push_back(add(new async_sink(*add(new text_dump_sink(dump.c_str())))));
 	}
 
-	bayer_map.close();
-	red_bayer_map.close();
-	green_bayer_map.close();
-	blue_bayer_map.close();
+	if (branches.empty())
+	{
+		return true;
+	}
+	tee_stage tee(branches);
+	return stream_image(result, tee);
+}
 
-	pixels.clear();
+void bitmap::mosaicking(const mosaic_outputs& outputs)
+{
+	PROFILE_SCOPE("mosaicking");
+	band_image source(m_width, m_height);
+	std::visit([&source](const auto& pixels) { convert_image(pixels, source); }, m_pixels);
 
-	pixels.resize(m_height * m_width);
+	cfa_descriptor bayer;
+	bayer.layout = cfa_layout::bayer;
+	bayer.pattern = bayer_pattern::grbg;
 
-	fuji_lens(pixels);
+	cfa_descriptor fuji;
+	fuji.layout = cfa_layout::xtrans;
 
-	for (int y = 0; y < m_height; y++)
+	// a bitmap of a single row or column is too small for the Bayer lens, the X-Trans one still runs
+	band_image result;
+	bool ok = true;
+	if (::demosaic(sample_mosaic(bayer), outputs.mode, result))
 	{
-		for (int x = 0; x < m_width; x++)
-		{
-			unsigned char r = static_cast<unsigned char> (pixels[y * m_width + x].r);
-			unsigned char g = static_cast<unsigned char> (pixels[y * m_width + x].g);
-			unsigned char b = static_cast<unsigned char> (pixels[y * m_width + x].b);
-
-			unsigned char color[] = { b, g, r };
-			unsigned char color_red[] = { 0, 0, r };
-			unsigned char color_green[] = { 0, g, 0 };
-			unsigned char color_blue[] = { b, 0, 0 };
-
-			fuji_map.write(reinterpret_cast<char*>(color), 3);
-			red_fuji_map.write(reinterpret_cast<char*>(color_red), 3);
-			blue_fuji_map.write(reinterpret_cast<char*>(color_blue), 3);
-			green_fuji_map.write(reinterpret_cast<char*>(color_green), 3);
-		}
-
-		fuji_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
-		red_fuji_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
-		green_fuji_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
-		blue_fuji_map.write(reinterpret_cast<char*>(bmpPad), paddingAmount);
+		ok = write_lens_outputs(result, source, "bayer", outputs);
 	}
 
-	fuji_map.close();
-	red_fuji_map.close();
-	green_fuji_map.close();
-	blue_fuji_map.close();
+	::demosaic(sample_mosaic(fuji), outputs.mode, result);
+	ok = write_lens_outputs(result, source, "fuji", outputs) && ok;
+
+	if (!ok)
+	{
+		std::cout << "File write not" << "\n";
+		return;
+	}
 
 	std::cout << "JESUS WEPT AS THERE WERE NO MORE WORLDS TO CONQUER" << "\n";
 }
\ No newline at end of file
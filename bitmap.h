@@ -1,7 +1,17 @@
 #pragma once
 
 #include <vector>
-#include "matrix.h"
+#include <variant>
+#include <atomic>
+#include "image.h"
+#include "resample.h"
+#include "rotate.h"
+#include "warp.h"
+#include "interpolate.h"
+#include "demosaic.h"
+#include "color.h"
+#include "pyramid.h"
+#include "cache.h"
 
 struct color3f {
 	double r, g, b;
@@ -10,13 +20,48 @@ struct color3f {
 	~color3f();
 };
 
+// Sample type and layout the pixels of a bitmap are stored in
+enum class pixel_format
+{
+	rgb8,
+	rgb8_planar,
+	rgb16,
+	rgb16_planar,
+	rgbf,
+	rgbf_planar
+};
+
+using pixel_storage = std::variant <
+	image<uint8_t, pixel_layout::interleaved>,
+	image<uint8_t, pixel_layout::planar>,
+	image<uint16_t, pixel_layout::interleaved>,
+	image<uint16_t, pixel_layout::planar>,
+	image<float, pixel_layout::interleaved>,
+	image<float, pixel_layout::planar>>;
+
+// Files mosaicking writes for each lens, unwanted ones cost nothing
+struct mosaic_outputs
+{
+	bool full = true; // bayer.bmp, fuji.bmp
+	bool channels = true; // red_bayer_map.bmp ...
+	bool difference = true; // bayer_difference.bmp, absolute difference to the source
+	bool text_dump = false; // bayer_logs.txt, one line per pixel
+	demosaic_mode mode = demosaic_mode::malvar;
+};
+
+class lazy_bitmap;
+
 class bitmap
 {
 public:
 
 	const char* path;
 
-	bitmap(int width, int height, const char* path);
+	bitmap(int width, int height, const char* path, pixel_format format = pixel_format::rgb8);
+	bitmap(const bitmap& other);
+	bitmap(bitmap&& other) noexcept;
+	bitmap& operator =(const bitmap& other);
+	bitmap& operator =(bitmap&& other) noexcept;
 
 	~bitmap();
 
@@ -24,27 +69,77 @@ public:
 
 	void set_color(const color3f& color, int x, int y);
 
+	pixel_format format() const;
+	void set_format(pixel_format format); // converts the stored pixels
+
+	pixel_storage& storage();
+	const pixel_storage& storage() const;
+
 	void read_file();
-	void export_file(const char* export_path) const;
+	bool export_file(const char* export_path) const; // false when the file could not be written
 
-	void mosaicking(char interpolation_type);
+	// demosaics with outputs.mode
+	void mosaicking(const mosaic_outputs& outputs = mosaic_outputs());
+
+	// sensor simulation: the image as seen through a colour filter array
+	mosaic_image sample_mosaic(const cfa_descriptor& cfa) const;
+	// replaces the pixels with the reconstruction of a mosaic, keeps the pixel format.
+	// fixed_point takes the integer path for 8 bit Bayer mosaics in bilinear or Malvar mode.
+	// False and the pixels untouched for a mosaic the engine turns down.
+	bool demosaic(const mosaic_image& mosaic, demosaic_mode mode = demosaic_mode::malvar, bool fixed_point = false);
 
 	void fuji_lens(std::vector <color3f>& pixels);
-	void bayer_lens(std::vector <color3f>& pixels);
+	void bayer_lens(std::vector <color3f>& pixels, demosaic_mode mode = demosaic_mode::malvar);
+
+	// linear_light filters in linear light instead of on the sRGB encoded values.
+	// fixed_point resamples 8 bit formats with integer arithmetic, down to 1/16 of the size.
+	bitmap rescale(int new_width, int new_height, resample_kernel kernel = resample_kernel::catmull_rom, bool linear_light = false, bool fixed_point = false) const;
+
+	// point interpolation by a policy of interpolate.h instead of a filtered kernel: a few taps
+	// per output pixel at any ratio, for previews and upscales
+	template <typename P>
+	bitmap rescale(int new_width, int new_height) const;
+	bitmap rescale(int new_width, int new_height, interpolation method) const;
 
-	bitmap rescale(int new_width, int new_height);
+	// several downscaled copies from one mip pyramid, sizes are width, height pairs. Cheaper
+	// than a rescale per size but approximate, see image_pyramid::resample
+	std::vector <bitmap> thumbnails(const std::vector <std::pair <int, int>>& sizes, resample_kernel kernel = resample_kernel::catmull_rom) const;
 
-	void rotate(double degree);
+	// multiples of 90 degrees are exact, other angles warp with a black border
+	void rotate(double degree, rotate_filter filter = rotate_filter::nearest);
+
+	// new_width x new_height pixels, each sampled where to_source maps it, see warp.h
+	bitmap warp(const perspective_transform& to_source, int new_width, int new_height, const warp_options& options = warp_options()) const;
 
 	void resize(int new_width, int new_height); // used while rotating
 
-	void grayscale();
+	void grayscale(luma_standard standard = luma_standard::bt601);
+
+	// in place, the channels then hold the components of space instead of r g b
+	void to_color_space(color_space space);
+	void from_color_space(color_space space);
+
+	// chain of operations run with fusion on evaluate(), see lazy.h
+	lazy_bitmap defer() const;
+
+	// changes whenever the pixels may have changed, copies share it until one of them is modified
+	uint64_t content_stamp() const;
 
 	int m_width;
 	int m_height;
 private:
+	void touch() { m_stamp.store(0, std::memory_order_relaxed); } // stamped again when next asked for
+	// pyramid of the pixels out of the global cache, built locally when the cache declines
+	std::shared_ptr <const image_pyramid> pyramid() const;
 
-	std::vector <color3f> m_colors;
-	double bicubic_interpolate(matrix& a, double y, double x);
-	matrix bicub_scaled_matrix(matrix& pixels, int y, int x);
-};
\ No newline at end of file
+	pixel_storage m_pixels;
+	mutable std::atomic <uint64_t> m_stamp;
+};
+
+template <typename P>
+bitmap bitmap::rescale(int new_width, int new_height) const
+{
+	bitmap rescaled(new_width, new_height, "rescaled.bmp", format());
+	std::visit([](const auto& src, auto& dst) { interpolate_image<P>(src, dst); }, m_pixels, rescaled.m_pixels);
+	return rescaled;
+}
\ No newline at end of file
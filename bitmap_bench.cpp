@@ -0,0 +1,299 @@
+#include "bitmap.h"
+#include "allocation_counter.h"
+#include <benchmark/benchmark.h>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Counts allocations of the timed part of an iteration only, setup between pause and resume is left out
+class allocation_meter
+{
+public:
+	void resume() { m_start = allocation_count(); }
+	void pause() { m_counted += allocation_count() - m_start; }
+	uint64_t counted() const { return m_counted; }
+
+private:
+	uint64_t m_start = 0;
+	uint64_t m_counted = 0;
+};
+
+// Smooth gradients with some texture so the filters and demosaics see realistic detail
+static bitmap synthetic_bitmap(int width, int height)
+{
+	bitmap result(width, height, "bench.bmp");
+	std::visit([width, height](auto& pixels)
+		{
+			using T = typename std::decay_t<decltype(pixels)>::sample_type;
+			for (int y = 0; y < height; y++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					T* row = pixels.row(y, c);
+					for (int x = 0; x < width; x++)
+					{
+						const double ramp = (x + (c + 1) * y) / double(width + 3 * height);
+						const double texture = ((x * 7 + y * 13 + c * 5) & 15) / 64.0;
+						row[x * std::decay_t<decltype(pixels)>::pixel_stride] = to_sample<T>(ramp * 0.75 + texture);
+					}
+				}
+			}
+		}, result.storage());
+	return result;
+}
+
+// Megapixels per second, bytes per second and allocations per op of the `pixels` pixels each iteration went through
+static void report(benchmark::State& state, double pixels, double bytes, const allocation_meter& meter)
+{
+	const double iterations = static_cast<double>(state.iterations());
+	state.counters["Mpixels"] = benchmark::Counter(pixels * iterations / 1e6, benchmark::Counter::kIsRate);
+	state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(meter.counted()), benchmark::Counter::kAvgIterations);
+	state.SetBytesProcessed(static_cast<int64_t>(bytes * iterations));
+}
+
+static double rgb_bytes(int width, int height)
+{
+	return 3.0 * width * height;
+}
+
+static void bm_read_file(benchmark::State& state)
+{
+	const int side = static_cast<int>(state.range(0));
+	const std::string path = "bench_read_" + std::to_string(side) + ".bmp";
+	synthetic_bitmap(side, side).export_file(path.c_str());
+
+	bitmap target(side, side, path.c_str());
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		meter.resume();
+		target.read_file();
+		meter.pause();
+		benchmark::DoNotOptimize(target.storage());
+	}
+	report(state, double(side) * side, rgb_bytes(side, side), meter);
+	std::remove(path.c_str());
+}
+
+static void bm_export_file(benchmark::State& state)
+{
+	const int side = static_cast<int>(state.range(0));
+	const std::string path = "bench_export_" + std::to_string(side) + ".bmp";
+	const bitmap source = synthetic_bitmap(side, side);
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		meter.resume();
+		source.export_file(path.c_str());
+		meter.pause();
+	}
+	report(state, double(side) * side, rgb_bytes(side, side), meter);
+	std::remove(path.c_str());
+}
+
+// One off rescales: the source is modified between iterations, so the pyramid cache never serves it
+static void rescale_by(benchmark::State& state, double factor)
+{
+	const int side = static_cast<int>(state.range(0));
+	const int target = static_cast<int>(side * factor);
+	bitmap source = synthetic_bitmap(side, side);
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		source.set_color(source.get_color(0, 0), 0, 0);
+		state.ResumeTiming();
+		meter.resume();
+		bitmap rescaled = source.rescale(target, target);
+		meter.pause();
+		benchmark::DoNotOptimize(rescaled.storage());
+	}
+	report(state, double(target) * target, rgb_bytes(side, side), meter);
+}
+
+static void bm_rescale_up(benchmark::State& state)
+{
+	rescale_by(state, 2.0);
+}
+
+static void bm_rescale_down(benchmark::State& state)
+{
+	rescale_by(state, 0.3);
+}
+
+// Bilinear point sampling down to the same size as bm_rescale_down, the cheap preview
+static void bm_rescale_preview(benchmark::State& state)
+{
+	const int side = static_cast<int>(state.range(0));
+	const int target = static_cast<int>(side * 0.3);
+	const bitmap source = synthetic_bitmap(side, side);
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		meter.resume();
+		bitmap preview = source.rescale(target, target, interpolation::bilinear);
+		meter.pause();
+		benchmark::DoNotOptimize(preview.storage());
+	}
+	report(state, double(target) * target, rgb_bytes(side, side), meter);
+}
+
+// Repeated downscales of unchanged pixels, after the first two they start from the cached pyramid
+static void bm_rescale_down_cached(benchmark::State& state)
+{
+	const int side = static_cast<int>(state.range(0));
+	const int target = static_cast<int>(side * 0.3);
+	bitmap source = synthetic_bitmap(side, side);
+	source.rescale(target, target);
+	source.rescale(target, target);
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		meter.resume();
+		bitmap rescaled = source.rescale(target, target);
+		meter.pause();
+		benchmark::DoNotOptimize(rescaled.storage());
+	}
+	report(state, double(target) * target, rgb_bytes(side, side), meter);
+	pyramid_cache::global().clear();
+}
+
+// In place operations work on a fresh copy every iteration, making and freeing the copy is not timed
+template <typename F>
+static void in_place(benchmark::State& state, const F& operation)
+{
+	const int side = static_cast<int>(state.range(0));
+	const bitmap source = synthetic_bitmap(side, side);
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		std::unique_ptr <bitmap> work = std::make_unique<bitmap>(source);
+		state.ResumeTiming();
+		meter.resume();
+		operation(*work);
+		meter.pause();
+		benchmark::DoNotOptimize(work->storage());
+		state.PauseTiming();
+		work.reset();
+		state.ResumeTiming();
+	}
+	report(state, double(side) * side, rgb_bytes(side, side), meter);
+}
+
+static void bm_rotate_arbitrary(benchmark::State& state)
+{
+	in_place(state, [](bitmap& b) { b.rotate(30.0); });
+}
+
+static void bm_rotate_right_angle(benchmark::State& state)
+{
+	in_place(state, [](bitmap& b) { b.rotate(90.0); });
+}
+
+// Keystone correction of a scan in one bicubic pass, edges clamped
+static void bm_warp_perspective(benchmark::State& state)
+{
+	const int side = static_cast<int>(state.range(0));
+	const bitmap source = synthetic_bitmap(side, side);
+	const double s = side;
+	const double corners[8] = { 0.05 * s, 0.02 * s, 0.97 * s, 0.0, s, s, 0.0, 0.95 * s };
+	const perspective_transform to_source = perspective_transform::quad(corners, side, side);
+	warp_options options;
+	options.filter = rotate_filter::bicubic;
+	options.border = border_mode::clamp;
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		meter.resume();
+		bitmap warped = source.warp(to_source, side, side, options);
+		meter.pause();
+		benchmark::DoNotOptimize(warped.storage());
+	}
+	report(state, double(side) * side, rgb_bytes(side, side), meter);
+}
+
+static void bm_grayscale(benchmark::State& state)
+{
+	in_place(state, [](bitmap& b) { b.grayscale(); });
+}
+
+// The pixel vector is kept across iterations like mosaicking keeps it between the two lenses
+template <typename F>
+static void lens(benchmark::State& state, const F& operation)
+{
+	const int side = static_cast<int>(state.range(0));
+	bitmap source = synthetic_bitmap(side, side);
+	std::vector <color3f> pixels;
+
+	allocation_meter meter;
+	for (auto _ : state)
+	{
+		meter.resume();
+		operation(source, pixels);
+		meter.pause();
+		benchmark::DoNotOptimize(pixels.data());
+	}
+	report(state, double(side) * side, rgb_bytes(side, side), meter);
+}
+
+static void bm_bayer_lens(benchmark::State& state)
+{
+	lens(state, [](bitmap& b, std::vector <color3f>& pixels) { b.bayer_lens(pixels); });
+}
+
+static void bm_fuji_lens(benchmark::State& state)
+{
+	lens(state, [](bitmap& b, std::vector <color3f>& pixels) { b.fuji_lens(pixels); });
+}
+
+// 256^2 up to 8192^2, doubling the side
+#define BITMAP_BENCHMARK(name) BENCHMARK(name)->RangeMultiplier(2)->Range(256, 8192)->Unit(benchmark::kMillisecond)->UseRealTime()
+
+BITMAP_BENCHMARK(bm_read_file);
+BITMAP_BENCHMARK(bm_export_file);
+BITMAP_BENCHMARK(bm_rescale_up);
+BITMAP_BENCHMARK(bm_rescale_down);
+BITMAP_BENCHMARK(bm_rescale_down_cached);
+BITMAP_BENCHMARK(bm_rescale_preview);
+BITMAP_BENCHMARK(bm_rotate_arbitrary);
+BITMAP_BENCHMARK(bm_rotate_right_angle);
+BITMAP_BENCHMARK(bm_warp_perspective);
+BITMAP_BENCHMARK(bm_grayscale);
+BITMAP_BENCHMARK(bm_bayer_lens);
+BITMAP_BENCHMARK(bm_fuji_lens);
+
+// Results also go to bench_output.txt as JSON unless --benchmark_out says otherwise
+int main(int argc, char** argv)
+{
+	std::vector <char*> args(argv, argv + argc);
+	std::string out = "--benchmark_out=bench_output.txt";
+	std::string format = "--benchmark_out_format=json";
+	bool has_out = false;
+	for (int i = 1; i < argc; i++)
+	{
+		has_out = has_out || std::string(argv[i]).rfind("--benchmark_out=", 0) == 0;
+	}
+	if (!has_out)
+	{
+		args.push_back(&out[0]);
+		args.push_back(&format[0]);
+	}
+
+	int count = static_cast<int>(args.size());
+	benchmark::Initialize(&count, args.data());
+	if (benchmark::ReportUnrecognizedArguments(count, args.data()))
+	{
+		return 1;
+	}
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
@@ -0,0 +1,379 @@
+#include "bmp_file.h"
+#include "profile.h"
+#include <iostream>
+#include <algorithm>
+#include <utility>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file()
+{
+	m_data = nullptr;
+	m_size = 0;
+#ifdef _WIN32
+	m_file = INVALID_HANDLE_VALUE;
+	m_mapping = nullptr;
+#else
+	m_fd = -1;
+#endif
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept : mapped_file()
+{
+	*this = std::move(other);
+}
+
+mapped_file& mapped_file::operator =(mapped_file&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(m_data, other.m_data);
+		std::swap(m_size, other.m_size);
+#ifdef _WIN32
+		std::swap(m_file, other.m_file);
+		std::swap(m_mapping, other.m_mapping);
+#else
+		std::swap(m_fd, other.m_fd);
+#endif
+	}
+	return *this;
+}
+
+mapped_file::~mapped_file()
+{
+	close();
+}
+
+bool mapped_file::open(const char* path)
+{
+	close();
+#ifdef _WIN32
+	m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (m_mapping == nullptr)
+	{
+		close();
+		return false;
+	}
+	m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+	m_size = static_cast<size_t>(size.QuadPart);
+#else
+	m_fd = ::open(path, O_RDONLY);
+	if (m_fd < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (fstat(m_fd, &info) != 0 || info.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	void* address = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+	if (address == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	// pixel rows are consumed front to back
+	madvise(address, info.st_size, MADV_SEQUENTIAL);
+	m_data = static_cast<const unsigned char*>(address);
+	m_size = static_cast<size_t>(info.st_size);
+#endif
+	if (m_data == nullptr)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void mapped_file::close()
+{
+#ifdef _WIN32
+	if (m_data != nullptr)
+	{
+		UnmapViewOfFile(m_data);
+	}
+	if (m_mapping != nullptr)
+	{
+		CloseHandle(m_mapping);
+	}
+	if (m_file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_file);
+	}
+	m_mapping = nullptr;
+	m_file = INVALID_HANDLE_VALUE;
+#else
+	if (m_data != nullptr)
+	{
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+	if (m_fd >= 0)
+	{
+		::close(m_fd);
+	}
+	m_fd = -1;
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+void mapped_file::release(const unsigned char* begin, size_t length) const
+{
+#ifndef _WIN32
+	// only whole pages inside the range can go
+	const uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t first = ((uintptr_t)begin + page - 1) & ~(page - 1);
+	uintptr_t last = ((uintptr_t)begin + length) & ~(page - 1);
+	if (last > first)
+	{
+		madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+	}
+#else
+	(void)begin;
+	(void)length;
+#endif
+}
+
+static uint32_t read_u32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint16_t read_u16(const unsigned char* p)
+{
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+bool parse_bmp_header(const unsigned char* data, size_t size, bmp_header& header)
+{
+	if (size < bmp_file_header_size + bmp_information_header_size || data[0] != 'B' || data[1] != 'M')
+	{
+		return false;
+	}
+
+	const unsigned char* fileHeader = data;
+	const unsigned char* informationHeader = data + bmp_file_header_size;
+
+	// BITMAPINFOHEADER or one of its longer successors
+	if (read_u32(informationHeader) < bmp_information_header_size)
+	{
+		return false;
+	}
+
+	header.file_size = read_u32(fileHeader + 2);
+	header.data_offset = read_u32(fileHeader + 10);
+	header.width = static_cast<int32_t>(read_u32(informationHeader + 4));
+	const int32_t height = static_cast<int32_t>(read_u32(informationHeader + 8));
+	header.top_down = height < 0;
+	header.height = header.top_down ? -height : height;
+	header.bits_per_pixel = read_u16(informationHeader + 14);
+	const uint32_t compression = read_u32(informationHeader + 16);
+
+	if (header.width <= 0 || header.height <= 0 || compression != 0)
+	{
+		return false;
+	}
+
+	header.palette_offset = bmp_file_header_size + read_u32(informationHeader);
+	header.palette_size = 0;
+	if (header.bits_per_pixel <= 8)
+	{
+		const uint32_t used = read_u32(informationHeader + 32);
+		header.palette_size = used == 0 || used > (1u << header.bits_per_pixel) ? 1 << header.bits_per_pixel : (int)used;
+		if (header.palette_offset + header.palette_size * 4u > size)
+		{
+			return false;
+		}
+	}
+
+	header.row_stride = ((header.width * header.bits_per_pixel + 31) / 32) * 4;
+	return header.data_offset + static_cast<size_t>(header.row_stride) * header.height <= size;
+}
+
+static void write_u32(unsigned char* p, uint32_t value)
+{
+	p[0] = value;
+	p[1] = value >> 8;
+	p[2] = value >> 16;
+	p[3] = value >> 24;
+}
+
+void write_bmp_header(unsigned char* out, int width, int height)
+{
+	const uint32_t rowStride = ((width * 3 + 3) / 4) * 4;
+	const uint32_t imageSize = rowStride * height;
+	const uint32_t headerSize = bmp_file_header_size + bmp_information_header_size;
+
+	unsigned char* fileHeader = out;
+	unsigned char* informationHeader = out + bmp_file_header_size;
+
+	std::fill(out, out + headerSize, 0);
+
+	//File Type
+	fileHeader[0] = 'B';
+	fileHeader[1] = 'M';
+	//File size
+	write_u32(fileHeader + 2, headerSize + imageSize);
+	//Pixel data offset
+	write_u32(fileHeader + 10, headerSize);
+
+	//Header size
+	write_u32(informationHeader, bmp_information_header_size);
+	//Image width and height
+	write_u32(informationHeader + 4, width);
+	write_u32(informationHeader + 8, height);
+	//Planes
+	informationHeader[12] = 1;
+	//Bits per pixel (RGB)
+	informationHeader[14] = 24;
+	//Image size, compression, resolution and palette stay 0
+	write_u32(informationHeader + 20, imageSize);
+}
+
+bool bmp_view::open(const char* path)
+{
+	if (!m_file.open(path))
+	{
+		std::cout << "File open not" << "\n";
+		return false;
+	}
+
+	if (!parse_bmp_header(m_file.data(), m_file.size(), m_header))
+	{
+		std::cout << "Bitmap the file is not" << "\n";
+		m_file.close();
+		return false;
+	}
+
+	if (m_header.bits_per_pixel != 24)
+	{
+		std::cout << "Only 24 bit bitmaps are read" << "\n";
+		m_file.close();
+		return false;
+	}
+
+	m_pixels = m_file.data() + m_header.data_offset;
+	m_stride = m_header.row_stride;
+	if (m_header.top_down)
+	{
+		// walk backwards so row 0 is still the bottom row
+		m_pixels += m_stride * (m_header.height - 1);
+		m_stride = -m_stride;
+	}
+	PROFILE_COUNT("bytes read", m_file.size());
+	return true;
+}
+
+void bmp_view::release_rows(int first, int last) const
+{
+	if (last <= first)
+	{
+		return;
+	}
+	// rows run backwards in memory for top-down files
+	const unsigned char* begin = m_stride > 0 ? row(first) : row(last - 1);
+	m_file.release(begin, static_cast<size_t>(last - first) * m_header.row_stride);
+}
+
+bmp_writer::bmp_writer()
+{
+	m_file = nullptr;
+	m_used = 0;
+	m_row_stride = 0;
+	m_failed = false;
+}
+
+bmp_writer::~bmp_writer()
+{
+	close();
+}
+
+bool bmp_writer::open(const char* path, int width, int height, size_t buffer_size)
+{
+	close();
+	m_file = std::fopen(path, "wb");
+	if (m_file == nullptr)
+	{
+		return false;
+	}
+	// the staging buffer replaces stdio buffering
+	std::setvbuf(m_file, nullptr, _IONBF, 0);
+
+	m_row_stride = ((width * 3 + 3) / 4) * 4;
+	const size_t headerSize = bmp_file_header_size + bmp_information_header_size;
+	const size_t total = headerSize + static_cast<size_t>(m_row_stride) * height;
+	size_t rows = buffer_size / m_row_stride;
+	rows = rows == 0 ? 1 : rows;
+	m_buffer.assign(std::min(total, headerSize + rows * m_row_stride), 0);
+
+	write_bmp_header(m_buffer.data(), width, height);
+	m_used = headerSize;
+	m_failed = false;
+	return true;
+}
+
+unsigned char* bmp_writer::next_row()
+{
+	if (m_used + m_row_stride > m_buffer.size())
+	{
+		flush();
+	}
+	unsigned char* row = m_buffer.data() + m_used;
+	// zero the padding bytes, the pixel bytes are overwritten by the caller
+	std::fill(row + m_row_stride - 3, row + m_row_stride, 0);
+	return row;
+}
+
+void bmp_writer::push_row()
+{
+	m_used += m_row_stride;
+}
+
+bool bmp_writer::flush()
+{
+	PROFILE_COUNT("bytes written", m_used);
+	if (m_used > 0 && std::fwrite(m_buffer.data(), 1, m_used, m_file) != m_used)
+	{
+		m_failed = true;
+	}
+	m_used = 0;
+	return !m_failed;
+}
+
+bool bmp_writer::close()
+{
+	if (m_file == nullptr)
+	{
+		return false;
+	}
+	flush();
+	if (std::fclose(m_file) != 0)
+	{
+		m_failed = true;
+	}
+	m_file = nullptr;
+	m_buffer.clear();
+	m_buffer.shrink_to_fit();
+	return !m_failed;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "image.h"
+
+// Read only memory mapping of a whole file
+class mapped_file
+{
+public:
+	mapped_file();
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator =(const mapped_file&) = delete;
+	mapped_file(mapped_file&& other) noexcept;
+	mapped_file& operator =(mapped_file&& other) noexcept;
+	~mapped_file();
+
+	bool open(const char* path);
+	void close();
+	// tells the OS the pages of [begin, begin + length) will not be read again
+	void release(const unsigned char* begin, size_t length) const;
+
+	const unsigned char* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bool is_open() const { return m_data != nullptr; }
+
+private:
+	const unsigned char* m_data;
+	size_t m_size;
+#ifdef _WIN32
+	void* m_file;
+	void* m_mapping;
+#else
+	int m_fd;
+#endif
+};
+
+const int bmp_file_header_size = 14;
+const int bmp_information_header_size = 40;
+
+struct bmp_header
+{
+	int width;
+	int height;
+	int bits_per_pixel;
+	bool top_down; // negative height in the file
+	uint32_t data_offset;
+	uint32_t file_size;
+	int row_stride; // bytes per row including padding
+	uint32_t palette_offset; // b g r x entries of 8 bit and smaller bitmaps
+	int palette_size;
+};
+
+// Checks the 14 + 40 byte headers, false if the data is not a bitmap we can read
+bool parse_bmp_header(const unsigned char* data, size_t size, bmp_header& header);
+
+// Fills the 54 header bytes of an uncompressed 24 bit bitmap
+void write_bmp_header(unsigned char* out, int width, int height);
+
+// Zero copy view of the pixel array of a 24 bit bitmap.
+// Row 0 is the first row stored in a bottom-up file, the same order read_file always used.
+class bmp_view
+{
+public:
+	bool open(const char* path);
+
+	int width() const { return m_header.width; }
+	int height() const { return m_header.height; }
+	const bmp_header& header() const { return m_header; }
+
+	// b g r triplets of row y
+	const unsigned char* row(int y) const
+	{
+		return m_pixels + m_stride * y;
+	}
+	ptrdiff_t stride() const { return m_stride; }
+
+	// drops rows [first, last) from memory, streaming readers call this behind them
+	void release_rows(int first, int last) const;
+
+private:
+	mapped_file m_file;
+	bmp_header m_header = {};
+	const unsigned char* m_pixels = nullptr;
+	ptrdiff_t m_stride = 0;
+};
+
+// Converts one row of b g r bytes into channel c of a typed row
+template <typename T, int Stride>
+inline void convert_bgr_channel(const unsigned char* __restrict in, T* __restrict out, int width, int c)
+{
+	const int source = 2 - c;
+	if constexpr (sample_traits<T>::is_integer)
+	{
+		// 8 bit -> n bit by repeating the byte, 255 maps onto the maximum exactly
+		const unsigned scale = static_cast<unsigned>(sample_traits<T>::max_value) / 255u;
+		for (int x = 0; x < width; x++)
+		{
+			out[x * Stride] = static_cast<T>(in[x * 3 + source] * scale);
+		}
+	}
+	else
+	{
+		const float scale = 1.0f / 255.0f;
+		for (int x = 0; x < width; x++)
+		{
+			out[x * Stride] = static_cast<T>(in[x * 3 + source] * scale);
+		}
+	}
+}
+
+// Converts rows [first, last) of the view into the working image
+template <typename T, pixel_layout L>
+void convert_bmp_rows(const bmp_view& view, image<T, L>& dst, int first, int last)
+{
+	for (int y = first; y < last; y++)
+	{
+		const unsigned char* in = view.row(y);
+		for (int c = 0; c < 3; c++)
+		{
+			convert_bgr_channel<T, image<T, L>::pixel_stride>(in, dst.row(y, c), view.width(), c);
+		}
+	}
+}
+
+// Writes a 24 bit bitmap row by row through a large staging buffer, so the
+// file is produced with a handful of big writes instead of one per pixel.
+class bmp_writer
+{
+public:
+	bmp_writer();
+	bmp_writer(const bmp_writer&) = delete;
+	bmp_writer& operator =(const bmp_writer&) = delete;
+	~bmp_writer();
+
+	bool open(const char* path, int width, int height, size_t buffer_size = 8 << 20);
+	// staging slot for the next row, padding is already zeroed
+	unsigned char* next_row();
+	void push_row();
+	bool close();
+
+	int row_stride() const { return m_row_stride; }
+
+private:
+	bool flush();
+
+	std::FILE* m_file;
+	std::vector <unsigned char> m_buffer;
+	size_t m_used;
+	int m_row_stride;
+	bool m_failed;
+};
+
+// Quantizes channel c of a typed row into the b g r bytes of a bitmap row
+template <typename T, int Stride>
+inline void encode_bgr_channel(const T* __restrict in, unsigned char* __restrict out, int width, int c)
+{
+	const int target = 2 - c;
+	if constexpr (std::is_same<T, uint8_t>::value)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			out[x * 3 + target] = in[x * Stride];
+		}
+	}
+	else if constexpr (sample_traits<T>::is_integer)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			out[x * 3 + target] = static_cast<unsigned char>((in[x * Stride] * 255u + 32767u) / 65535u);
+		}
+	}
+	else
+	{
+		for (int x = 0; x < width; x++)
+		{
+			float v = in[x * Stride] * 255.0f + 0.5f;
+			v = v < 0.0f ? 0.0f : (v > 255.0f ? 255.0f : v);
+			out[x * 3 + target] = static_cast<unsigned char>(v);
+		}
+	}
+}
+
+template <typename T, pixel_layout L>
+void encode_bmp_row(const image<T, L>& src, int y, unsigned char* out)
+{
+	for (int c = 0; c < 3; c++)
+	{
+		encode_bgr_channel<T, image<T, L>::pixel_stride>(src.row(y, c), out, src.width(), c);
+	}
+}
@@ -0,0 +1,109 @@
+#include "cache.h"
+#include "profile.h"
+#include <algorithm>
+
+pyramid_cache::pyramid_cache(size_t capacity)
+{
+	m_capacity = capacity;
+	m_size = 0;
+}
+
+pyramid_cache& pyramid_cache::global()
+{
+	static pyramid_cache cache;
+	return cache;
+}
+
+void pyramid_cache::set_capacity(size_t bytes)
+{
+	std::lock_guard <std::mutex> lock(m_mutex);
+	m_capacity = bytes;
+	evict();
+}
+
+size_t pyramid_cache::capacity() const
+{
+	std::lock_guard <std::mutex> lock(m_mutex);
+	return m_capacity;
+}
+
+size_t pyramid_cache::size_bytes() const
+{
+	std::lock_guard <std::mutex> lock(m_mutex);
+	return m_size;
+}
+
+void pyramid_cache::clear()
+{
+	std::lock_guard <std::mutex> lock(m_mutex);
+	m_entries.clear();
+	m_index.clear();
+	m_seen.clear();
+	m_size = 0;
+}
+
+void pyramid_cache::evict()
+{
+	while (m_size > m_capacity && !m_entries.empty())
+	{
+		m_size -= m_entries.back().bytes;
+		m_index.erase(m_entries.back().source);
+		m_entries.pop_back();
+	}
+}
+
+std::shared_ptr <const image_pyramid> pyramid_cache::get(uint64_t source, size_t bytes, const std::function<void(image_pyramid&)>& build)
+{
+	const size_t seen_limit = 64;
+
+	{
+		std::lock_guard <std::mutex> lock(m_mutex);
+		if (bytes > m_capacity)
+		{
+			// would be built and dropped again on every repeat, the caller is better off without
+			PROFILE_COUNT("pyramid cache oversized", 1);
+			return nullptr;
+		}
+		auto found = m_index.find(source);
+		if (found != m_index.end())
+		{
+			PROFILE_COUNT("pyramid cache hits", 1);
+			m_entries.splice(m_entries.begin(), m_entries, found->second);
+			return found->second->pyramid;
+		}
+		PROFILE_COUNT("pyramid cache misses", 1);
+
+		auto seen = std::find(m_seen.begin(), m_seen.end(), source);
+		if (seen == m_seen.end())
+		{
+			if (m_seen.size() == seen_limit)
+			{
+				m_seen.erase(m_seen.begin());
+			}
+			m_seen.push_back(source);
+			return nullptr;
+		}
+		m_seen.erase(seen);
+	}
+
+	// built outside the lock, other sources stay served meanwhile
+	std::shared_ptr <image_pyramid> pyramid = std::make_shared<image_pyramid>();
+	{
+		PROFILE_SCOPE("build pyramid");
+		build(*pyramid);
+	}
+	const size_t built = pyramid->size_bytes();
+
+	std::lock_guard <std::mutex> lock(m_mutex);
+	auto found = m_index.find(source);
+	if (found != m_index.end())
+	{
+		// another thread got there first
+		return found->second->pyramid;
+	}
+	m_entries.push_front({ source, pyramid, built });
+	m_index[source] = m_entries.begin();
+	m_size += built;
+	evict();
+	return pyramid;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "pyramid.h"
+
+// Mip pyramids of recently rescaled sources, least recently used dropped first once the
+// total passes the capacity. Sources are identified by a key derived from a content stamp
+// that changes on every modification (see bitmap::content_stamp), so a stale pyramid is
+// never returned. A pyramid is only built the second time a source is asked for, one-off
+// rescales pay nothing for the cache, and never when it would not fit.
+class pyramid_cache
+{
+public:
+	explicit pyramid_cache(size_t capacity = 256 << 20);
+
+	static pyramid_cache& global();
+
+	void set_capacity(size_t bytes);
+	size_t capacity() const;
+	size_t size_bytes() const;
+	void clear();
+
+	// pyramid of source, built with build on a repeated request; nullptr on the first one and
+	// whenever bytes, the size build will come to, is more than the capacity
+	std::shared_ptr <const image_pyramid> get(uint64_t source, size_t bytes, const std::function<void(image_pyramid&)>& build);
+
+private:
+	void evict();
+
+	struct entry
+	{
+		uint64_t source;
+		std::shared_ptr <const image_pyramid> pyramid;
+		size_t bytes;
+	};
+
+	mutable std::mutex m_mutex;
+	size_t m_capacity;
+	size_t m_size;
+	std::list <entry> m_entries; // most recently used first
+	std::unordered_map <uint64_t, std::list <entry>::iterator> m_index;
+	std::vector <uint64_t> m_seen; // sources asked for once, oldest first
+};
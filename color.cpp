@@ -0,0 +1,240 @@
+#include "color.h"
+#include <array>
+#include <cmath>
+
+struct luma_weights
+{
+	float r, g, b;
+};
+
+static luma_weights weights_of(luma_standard standard)
+{
+	if (standard == luma_standard::bt709)
+	{
+		return { 0.2126f, 0.7152f, 0.0722f };
+	}
+	return { 0.299f, 0.587f, 0.114f };
+}
+
+void luma_row(const float* r, const float* g, const float* b, float* out, int width, luma_standard standard)
+{
+	const luma_weights k = weights_of(standard);
+	for (int x = 0; x < width; x++)
+	{
+		out[x] = k.r * r[x] + k.g * g[x] + k.b * b[x];
+	}
+}
+
+void rgb_to_ycbcr_row(float* __restrict r, float* __restrict g, float* __restrict b, int width, luma_standard standard)
+{
+	const luma_weights k = weights_of(standard);
+	const float cb_scale = 0.5f / (1.0f - k.b), cr_scale = 0.5f / (1.0f - k.r);
+	for (int x = 0; x < width; x++)
+	{
+		const float y = k.r * r[x] + k.g * g[x] + k.b * b[x];
+		const float cb = (b[x] - y) * cb_scale + 0.5f;
+		const float cr = (r[x] - y) * cr_scale + 0.5f;
+		r[x] = y;
+		g[x] = cb;
+		b[x] = cr;
+	}
+}
+
+void ycbcr_to_rgb_row(float* __restrict y, float* __restrict cb, float* __restrict cr, int width, luma_standard standard)
+{
+	const luma_weights k = weights_of(standard);
+	const float cb_scale = 2.0f * (1.0f - k.b), cr_scale = 2.0f * (1.0f - k.r);
+	const float inverse_g = 1.0f / k.g;
+	for (int x = 0; x < width; x++)
+	{
+		const float r = y[x] + (cr[x] - 0.5f) * cr_scale;
+		const float b = y[x] + (cb[x] - 0.5f) * cb_scale;
+		const float g = (y[x] - k.r * r - k.b * b) * inverse_g;
+		y[x] = r;
+		cb[x] = g;
+		cr[x] = b;
+	}
+}
+
+void rgb_to_hsv_row(float* __restrict r, float* __restrict g, float* __restrict b, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		const float max = std::max(r[x], std::max(g[x], b[x]));
+		const float min = std::min(r[x], std::min(g[x], b[x]));
+		const float delta = max - min;
+		const float inverse = delta > 0.0f ? 1.0f / (6.0f * delta) : 0.0f;
+
+		// selects instead of branches so the loop stays vectorisable
+		float h = max == r[x] ? (g[x] - b[x]) * inverse : (max == g[x] ? (b[x] - r[x]) * inverse + 1.0f / 3.0f : (r[x] - g[x]) * inverse + 2.0f / 3.0f);
+		h = h < 0.0f ? h + 1.0f : h;
+
+		r[x] = h;
+		g[x] = max > 0.0f ? delta / max : 0.0f;
+		b[x] = max;
+	}
+}
+
+void hsv_to_rgb_row(float* __restrict h, float* __restrict s, float* __restrict v, int width)
+{
+	// channel n is v - v s clamp(min(k, 4 - k), 0, 1) with k = (n + 6 h) mod 6
+	auto channel = [](float n, float hue, float saturation, float value)
+	{
+		float k = n + hue * 6.0f;
+		k = k >= 6.0f ? k - 6.0f : k;
+		k = k >= 6.0f ? k - 6.0f : k;
+		const float ramp = std::min(std::max(std::min(k, 4.0f - k), 0.0f), 1.0f);
+		return value - value * saturation * ramp;
+	};
+
+	for (int x = 0; x < width; x++)
+	{
+		const float r = channel(5.0f, h[x], s[x], v[x]);
+		const float g = channel(3.0f, h[x], s[x], v[x]);
+		const float b = channel(1.0f, h[x], s[x], v[x]);
+		h[x] = r;
+		s[x] = g;
+		v[x] = b;
+	}
+}
+
+// CIE constants, delta = 6 / 29
+static const float lab_delta = 6.0f / 29.0f;
+static const float white_x = 0.95047f, white_z = 1.08883f;
+
+static float lab_f(float t)
+{
+	return t > lab_delta * lab_delta * lab_delta ? std::cbrt(t) : t / (3.0f * lab_delta * lab_delta) + 4.0f / 29.0f;
+}
+
+static float lab_f_inverse(float f)
+{
+	return f > lab_delta ? f * f * f : 3.0f * lab_delta * lab_delta * (f - 4.0f / 29.0f);
+}
+
+void rgb_to_lab_row(float* __restrict r, float* __restrict g, float* __restrict b, int width)
+{
+	srgb_to_linear_row(r, width);
+	srgb_to_linear_row(g, width);
+	srgb_to_linear_row(b, width);
+
+	for (int x = 0; x < width; x++)
+	{
+		const float fx = lab_f((0.4124564f * r[x] + 0.3575761f * g[x] + 0.1804375f * b[x]) / white_x);
+		const float fy = lab_f(0.2126729f * r[x] + 0.7151522f * g[x] + 0.0721750f * b[x]);
+		const float fz = lab_f((0.0193339f * r[x] + 0.1191920f * g[x] + 0.9503041f * b[x]) / white_z);
+
+		r[x] = (116.0f * fy - 16.0f) / 100.0f;
+		g[x] = (500.0f * (fx - fy) + 128.0f) / 255.0f;
+		b[x] = (200.0f * (fy - fz) + 128.0f) / 255.0f;
+	}
+}
+
+void lab_to_rgb_row(float* __restrict l, float* __restrict a, float* __restrict b, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		const float fy = (l[x] * 100.0f + 16.0f) / 116.0f;
+		const float fx = fy + (a[x] * 255.0f - 128.0f) / 500.0f;
+		const float fz = fy - (b[x] * 255.0f - 128.0f) / 200.0f;
+
+		const float X = lab_f_inverse(fx) * white_x;
+		const float Y = lab_f_inverse(fy);
+		const float Z = lab_f_inverse(fz) * white_z;
+
+		l[x] = 3.2404542f * X - 1.5371385f * Y - 0.4985314f * Z;
+		a[x] = -0.9692660f * X + 1.8760108f * Y + 0.0415560f * Z;
+		b[x] = 0.0556434f * X - 0.2040259f * Y + 1.0572252f * Z;
+	}
+
+	linear_to_srgb_row(l, width);
+	linear_to_srgb_row(a, width);
+	linear_to_srgb_row(b, width);
+}
+
+float srgb_to_linear(float value)
+{
+	return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb(float value)
+{
+	return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+void srgb_to_linear_row(float* values, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		values[x] = srgb_to_linear(values[x]);
+	}
+}
+
+void linear_to_srgb_row(float* values, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		values[x] = linear_to_srgb(values[x]);
+	}
+}
+
+static const int linear_table_size = 4096;
+
+// srgb_to_linear at i / (size - 1), one extra entry so interpolation never reads past the end
+static const float* srgb_linear_table()
+{
+	static const std::array <float, linear_table_size + 1> table = []
+	{
+		std::array <float, linear_table_size + 1> t{};
+		for (int i = 0; i < linear_table_size; i++)
+		{
+			t[i] = srgb_to_linear(i / (float)(linear_table_size - 1));
+		}
+		t[linear_table_size] = t[linear_table_size - 1];
+		return t;
+	}();
+	return table.data();
+}
+
+void srgb_to_linear_fast_row(float* values, int width)
+{
+	const float* table = srgb_linear_table();
+	const float scale = (float)(linear_table_size - 1);
+	for (int x = 0; x < width; x++)
+	{
+		float v = values[x] * scale;
+		v = v < 0.0f ? 0.0f : (v > scale ? scale : v);
+		const int i = (int)v;
+		const float f = v - i;
+		values[x] = table[i] + (table[i + 1] - table[i]) * f;
+	}
+}
+
+void linear_to_srgb_fast_row(float* values, int width)
+{
+	for (int x = 0; x < width; x++)
+	{
+		float v = values[x];
+		v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+		// x^(1 / 2.4) fitted on x^(1 / 2), x^(1 / 4) and x^(1 / 8)
+		const float s1 = std::sqrt(v);
+		const float s2 = std::sqrt(s1);
+		const float s3 = std::sqrt(s2);
+		const float curve = 0.585122381f * s1 + 0.783140355f * s2 - 0.368262736f * s3;
+		values[x] = v <= 0.0031308f ? v * 12.92f : curve;
+	}
+}
+
+const float* srgb8_linear_table()
+{
+	static const std::array <float, 256> table = []
+	{
+		std::array <float, 256> t{};
+		for (int i = 0; i < 256; i++)
+		{
+			t[i] = srgb_to_linear(i / 255.0f);
+		}
+		return t;
+	}();
+	return table.data();
+}
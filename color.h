@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include "image.h"
+#include "thread_pool.h"
+
+// Luma weights of the two broadcast standards
+enum class luma_standard
+{
+	bt601, // 0.299 0.587 0.114, SD video and JPEG
+	bt709 // 0.2126 0.7152 0.0722, HD video and sRGB primaries
+};
+
+// Colour spaces the three channels can be converted into. Values stay in 0.0 - 1.0 so they fit
+// every sample type: Cb and Cr are offset by 0.5, hue is in turns, L* is over 100, a* and b*
+// are offset by 128 and over 255.
+enum class color_space
+{
+	ycbcr,
+	hsv,
+	lab
+};
+
+// Row kernels on three float arrays of the same width, in place
+void luma_row(const float* r, const float* g, const float* b, float* out, int width, luma_standard standard);
+void rgb_to_ycbcr_row(float* r, float* g, float* b, int width, luma_standard standard);
+void ycbcr_to_rgb_row(float* y, float* cb, float* cr, int width, luma_standard standard);
+void rgb_to_hsv_row(float* r, float* g, float* b, int width);
+void hsv_to_rgb_row(float* h, float* s, float* v, int width);
+void rgb_to_lab_row(float* r, float* g, float* b, int width); // sRGB encoded input, D65 white
+void lab_to_rgb_row(float* l, float* a, float* b, int width);
+
+// sRGB transfer curve
+float srgb_to_linear(float value);
+float linear_to_srgb(float value);
+void srgb_to_linear_row(float* values, int width);
+void linear_to_srgb_row(float* values, int width);
+
+// Table driven and approximate versions for bulk conversions. The decode interpolates a
+// 4096 entry table (error below 0.001 of an 8 bit step), the encode is a fit on three square
+// roots (error below 0.4 of an 8 bit step, so bytes round to the exact value or next to it).
+void srgb_to_linear_fast_row(float* values, int width);
+void linear_to_srgb_fast_row(float* values, int width);
+
+// 256 entry table from a byte to n / 255 through the sRGB curve
+const float* srgb8_linear_table();
+
+// Converts a row of one channel to floats, bytes go through table when there is one
+template <typename T, int Stride>
+inline void load_channel(const T* __restrict in, float* __restrict out, int width, const float* table)
+{
+	if constexpr (std::is_same<T, uint8_t>::value)
+	{
+		if (table != nullptr)
+		{
+			for (int x = 0; x < width; x++)
+			{
+				out[x] = table[in[x * Stride]];
+			}
+			return;
+		}
+	}
+
+	{
+		const float scale = static_cast<float>(1.0 / sample_traits<T>::max_value);
+		for (int x = 0; x < width; x++)
+		{
+			out[x] = in[x * Stride] * scale;
+		}
+	}
+}
+
+// Rounds and clamps a float row back into one channel
+template <typename T, int Stride>
+inline void store_channel(const float* __restrict in, T* __restrict out, int width)
+{
+	if constexpr (sample_traits<T>::is_integer)
+	{
+		const float scale = static_cast<float>(sample_traits<T>::max_value);
+		for (int x = 0; x < width; x++)
+		{
+			float v = in[x] * scale + 0.5f;
+			v = v < 0.0f ? 0.0f : (v > scale ? scale : v);
+			out[x * Stride] = static_cast<T>(v);
+		}
+	}
+	else
+	{
+		for (int x = 0; x < width; x++)
+		{
+			out[x * Stride] = in[x];
+		}
+	}
+}
+
+// Rounds the three float rows into row y of dst, interleaved rows in one pass
+template <typename D, pixel_layout DL>
+inline void store_pixels(const float* const channel[3], image<D, DL>& dst, int y)
+{
+	const int width = dst.width();
+	if constexpr (DL == pixel_layout::interleaved && sample_traits<D>::is_integer)
+	{
+		const float scale = static_cast<float>(sample_traits<D>::max_value);
+		const float* __restrict r = channel[0];
+		const float* __restrict g = channel[1];
+		const float* __restrict b = channel[2];
+		D* __restrict out = dst.row(y);
+		for (int x = 0; x < width; x++)
+		{
+			out[3 * x] = static_cast<D>(std::min(std::max(r[x] * scale + 0.5f, 0.0f), scale));
+			out[3 * x + 1] = static_cast<D>(std::min(std::max(g[x] * scale + 0.5f, 0.0f), scale));
+			out[3 * x + 2] = static_cast<D>(std::min(std::max(b[x] * scale + 0.5f, 0.0f), scale));
+		}
+	}
+	else
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			store_channel<D, DL == pixel_layout::interleaved ? 3 : 1>(channel[c], dst.row(y, c), width);
+		}
+	}
+}
+
+// Runs kernel(r, g, b, width) over every row of src into dst of the same size. Rows are
+// unpacked into three float arrays and packed again, so one kernel serves every sample type
+// and layout. Byte samples can be unpacked through a 256 entry table to fold a transfer curve into the load.
+template <typename S, pixel_layout SL, typename D, pixel_layout DL, typename F>
+void transform_pixels(const image<S, SL>& src, image<D, DL>& dst, const F& kernel, const float* table = nullptr)
+{
+	const int width = src.width();
+
+	parallel_rows(src.height(), [&](int first, int last)
+		{
+			std::vector <float> rows(static_cast<size_t>(width) * 3);
+			float* channel[3] = { rows.data(), rows.data() + width, rows.data() + 2 * width };
+			for (int y = first; y < last; y++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					load_channel<S, image<S, SL>::pixel_stride>(src.row(y, c), channel[c], width, table);
+				}
+				kernel(channel[0], channel[1], channel[2], width);
+				for (int c = 0; c < 3; c++)
+				{
+					store_channel<D, image<D, DL>::pixel_stride>(channel[c], dst.row(y, c), width);
+				}
+			}
+		});
+}
+
+// In place
+template <typename T, pixel_layout L, typename F>
+void transform_pixels(image<T, L>& img, const F& kernel, const float* table = nullptr)
+{
+	transform_pixels(img, img, kernel, table);
+}
+
+// Every pixel becomes its luma in all three channels
+template <typename T, pixel_layout L>
+void grayscale(image<T, L>& img, luma_standard standard = luma_standard::bt601)
+{
+	transform_pixels(img, [standard](float* r, float* g, float* b, int width)
+		{
+			luma_row(r, g, b, r, width, standard);
+			std::copy(r, r + width, g);
+			std::copy(r, r + width, b);
+		});
+}
+
+template <typename T, pixel_layout L>
+void to_color_space(image<T, L>& img, color_space space, luma_standard standard = luma_standard::bt601)
+{
+	transform_pixels(img, [space, standard](float* r, float* g, float* b, int width)
+		{
+			switch (space)
+			{
+			case color_space::ycbcr: rgb_to_ycbcr_row(r, g, b, width, standard); break;
+			case color_space::hsv: rgb_to_hsv_row(r, g, b, width); break;
+			case color_space::lab: rgb_to_lab_row(r, g, b, width); break;
+			}
+		});
+}
+
+template <typename T, pixel_layout L>
+void from_color_space(image<T, L>& img, color_space space, luma_standard standard = luma_standard::bt601)
+{
+	transform_pixels(img, [space, standard](float* x, float* y, float* z, int width)
+		{
+			switch (space)
+			{
+			case color_space::ycbcr: ycbcr_to_rgb_row(x, y, z, width, standard); break;
+			case color_space::hsv: hsv_to_rgb_row(x, y, z, width); break;
+			case color_space::lab: lab_to_rgb_row(x, y, z, width); break;
+			}
+		});
+}
+
+// sRGB encoded -> linear light, bytes are decoded straight out of the table
+template <typename T, pixel_layout L>
+void linearize(image<T, L>& img)
+{
+	if constexpr (std::is_same<T, uint8_t>::value)
+	{
+		transform_pixels(img, [](float*, float*, float*, int) {}, srgb8_linear_table());
+	}
+	else
+	{
+		transform_pixels(img, [](float* r, float* g, float* b, int width)
+			{
+				srgb_to_linear_row(r, width);
+				srgb_to_linear_row(g, width);
+				srgb_to_linear_row(b, width);
+			});
+	}
+}
+
+// linear light -> sRGB encoded
+template <typename T, pixel_layout L>
+void delinearize(image<T, L>& img)
+{
+	transform_pixels(img, [](float* r, float* g, float* b, int width)
+		{
+			linear_to_srgb_row(r, width);
+			linear_to_srgb_row(g, width);
+			linear_to_srgb_row(b, width);
+		});
+}
@@ -0,0 +1,725 @@
+#include "demosaic.h"
+#include "thread_pool.h"
+#include "profile.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// 5x5 stencils, [dy + 2][dx + 2], already divided by their scale
+typedef float stencil[5][5];
+
+static const stencil identity_stencil =
+{
+	{ 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0 },
+	{ 0, 0, 1, 0, 0 },
+	{ 0, 0, 0, 0, 0 },
+	{ 0, 0, 0, 0, 0 }
+};
+
+// bilinear: green at red / blue, red / blue at green with the colour left and right, above and below, and diagonal
+static const stencil bilinear_stencils[4] =
+{
+	{
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0, 0.25f, 0, 0 },
+		{ 0, 0.25f, 0, 0.25f, 0 },
+		{ 0, 0, 0.25f, 0, 0 },
+		{ 0, 0, 0, 0, 0 }
+	},
+	{
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0.5f, 0, 0.5f, 0 },
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0, 0, 0, 0 }
+	},
+	{
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0, 0.5f, 0, 0 },
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0, 0.5f, 0, 0 },
+		{ 0, 0, 0, 0, 0 }
+	},
+	{
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0.25f, 0, 0.25f, 0 },
+		{ 0, 0, 0, 0, 0 },
+		{ 0, 0.25f, 0, 0.25f, 0 },
+		{ 0, 0, 0, 0, 0 }
+	}
+};
+
+// Malvar, He, Cutler 2004, same four cases, all over 8
+static const stencil malvar_stencils[4] =
+{
+	{
+		{ 0, 0, -1 / 8.0f, 0, 0 },
+		{ 0, 0, 2 / 8.0f, 0, 0 },
+		{ -1 / 8.0f, 2 / 8.0f, 4 / 8.0f, 2 / 8.0f, -1 / 8.0f },
+		{ 0, 0, 2 / 8.0f, 0, 0 },
+		{ 0, 0, -1 / 8.0f, 0, 0 }
+	},
+	{
+		{ 0, 0, 0.5f / 8.0f, 0, 0 },
+		{ 0, -1 / 8.0f, 0, -1 / 8.0f, 0 },
+		{ -1 / 8.0f, 4 / 8.0f, 5 / 8.0f, 4 / 8.0f, -1 / 8.0f },
+		{ 0, -1 / 8.0f, 0, -1 / 8.0f, 0 },
+		{ 0, 0, 0.5f / 8.0f, 0, 0 }
+	},
+	{
+		{ 0, 0, -1 / 8.0f, 0, 0 },
+		{ 0, -1 / 8.0f, 4 / 8.0f, -1 / 8.0f, 0 },
+		{ 0.5f / 8.0f, 0, 5 / 8.0f, 0, 0.5f / 8.0f },
+		{ 0, -1 / 8.0f, 4 / 8.0f, -1 / 8.0f, 0 },
+		{ 0, 0, -1 / 8.0f, 0, 0 }
+	},
+	{
+		{ 0, 0, -1.5f / 8.0f, 0, 0 },
+		{ 0, 2 / 8.0f, 0, 2 / 8.0f, 0 },
+		{ -1.5f / 8.0f, 0, 6 / 8.0f, 0, -1.5f / 8.0f },
+		{ 0, 2 / 8.0f, 0, 2 / 8.0f, 0 },
+		{ 0, 0, -1.5f / 8.0f, 0, 0 }
+	}
+};
+
+// Stencils of one row parity and one output channel merged into a single list of taps,
+// each with the weight for even and for odd columns
+struct row_taps
+{
+	int count = 0;
+	int dx[25], dy[25];
+	float weight[25][2];
+
+	void add(const stencil& s, int parity)
+	{
+		for (int y = 0; y < 5; y++)
+		{
+			for (int x = 0; x < 5; x++)
+			{
+				if (s[y][x] == 0.0f)
+				{
+					continue;
+				}
+				int t = 0;
+				while (t < count && (dx[t] != x - 2 || dy[t] != y - 2))
+				{
+					t++;
+				}
+				if (t == count)
+				{
+					dx[t] = x - 2;
+					dy[t] = y - 2;
+					weight[t][0] = weight[t][1] = 0.0f;
+					count++;
+				}
+				weight[t][parity] = s[y][x];
+			}
+		}
+	}
+};
+
+// Taps for both row parities and every output channel
+struct phase_table
+{
+	row_taps taps[2][3];
+
+	phase_table(bayer_pattern pattern, const stencil* stencils)
+	{
+		for (int phase = 0; phase < 4; phase++)
+		{
+			const int x = phase & 1, y = phase >> 1;
+			const int native = bayer_channel(pattern, x, y);
+			for (int c = 0; c < 3; c++)
+			{
+				if (c == native)
+				{
+					taps[y][c].add(identity_stencil, x);
+				}
+				else if (c == 1)
+				{
+					taps[y][c].add(stencils[0], x);
+				}
+				else if (native == 1)
+				{
+					// green site: is the wanted colour left and right of it, or above and below
+					taps[y][c].add(stencils[bayer_channel(pattern, x + 1, y) == c ? 1 : 2], x);
+				}
+				else
+				{
+					taps[y][c].add(stencils[3], x);
+				}
+			}
+		}
+	}
+};
+
+static void demosaic_linear(const padded_mosaic& mosaic, const phase_table& table, image<float, pixel_layout::planar>& out)
+{
+	const int width = mosaic.width;
+	const int pairs = width / 2;
+	const ptrdiff_t stride = mosaic.stride;
+
+	parallel_rows(mosaic.height, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				const float* center = mosaic.row(y);
+				for (int c = 0; c < 3; c++)
+				{
+					const row_taps& taps = table.taps[y & 1][c];
+					float* __restrict dst = out.row(y, c);
+					std::fill(dst, dst + width, 0.0f);
+					// one tap at a time over the whole row, the even / odd weight pair vectorises as is
+					for (int t = 0; t < taps.count; t++)
+					{
+						const float* __restrict src = center + taps.dy[t] * stride + taps.dx[t];
+						const float even = taps.weight[t][0], odd = taps.weight[t][1];
+						for (int i = 0; i < pairs; i++)
+						{
+							dst[2 * i] += even * src[2 * i];
+							dst[2 * i + 1] += odd * src[2 * i + 1];
+						}
+						if (width & 1)
+						{
+							dst[width - 1] += even * src[width - 1];
+						}
+					}
+				}
+			}
+		});
+}
+
+// Adaptive homogeneity-directed demosaic (Hirakawa, Parks 2005): build a horizontally and a
+// vertically interpolated image, then take per pixel the one whose neighbourhood is more
+// homogeneous in luminance and chroma.
+static void demosaic_ahd(const padded_mosaic& mosaic, bayer_pattern pattern, image<float, pixel_layout::planar>& out)
+{
+	const int width = mosaic.width, height = mosaic.height;
+	const ptrdiff_t stride = mosaic.stride;
+
+	// 0 = horizontal, 1 = vertical
+	padded_mosaic green[2];
+	padded_mosaic rgb[2][3];
+	for (int d = 0; d < 2; d++)
+	{
+		green[d].resize(width, height);
+		for (int c = 0; c < 3; c++)
+		{
+			rgb[d][c].resize(width, height);
+		}
+	}
+
+	// green along each direction, Hamilton-Adams with second order correction
+	parallel_rows(height, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				const float* m = mosaic.row(y);
+				float* gh = green[0].row(y);
+				float* gv = green[1].row(y);
+				for (int x = 0; x < width; x++)
+				{
+					if (bayer_channel(pattern, x, y) == 1)
+					{
+						gh[x] = gv[x] = m[x];
+						continue;
+					}
+					gh[x] = (m[x - 1] + m[x + 1]) * 0.5f + (2 * m[x] - m[x - 2] - m[x + 2]) * 0.25f;
+					gv[x] = (m[x - stride] + m[x + stride]) * 0.5f + (2 * m[x] - m[x - 2 * stride] - m[x + 2 * stride]) * 0.25f;
+				}
+			}
+		});
+	green[0].mirror_borders();
+	green[1].mirror_borders();
+
+	// red and blue from colour differences against the directional green
+	parallel_rows(height, [&](int first, int last)
+		{
+			for (int d = 0; d < 2; d++)
+			{
+				for (int y = first; y < last; y++)
+				{
+					const float* m = mosaic.row(y);
+					const float* g = green[d].row(y);
+					for (int x = 0; x < width; x++)
+					{
+						const int native = bayer_channel(pattern, x, y);
+						float value[3];
+						value[1] = g[x];
+						for (int c = 0; c < 3; c += 2)
+						{
+							if (c == native)
+							{
+								value[c] = m[x];
+							}
+							else if (native == 1)
+							{
+								const ptrdiff_t step = bayer_channel(pattern, x + 1, y) == c ? 1 : stride;
+								value[c] = g[x] + ((m[x - step] - g[x - step]) + (m[x + step] - g[x + step])) * 0.5f;
+							}
+							else
+							{
+								const ptrdiff_t a = -stride - 1, b = -stride + 1, e = stride - 1, f = stride + 1;
+								value[c] = g[x] + ((m[x + a] - g[x + a]) + (m[x + b] - g[x + b]) + (m[x + e] - g[x + e]) + (m[x + f] - g[x + f])) * 0.25f;
+							}
+						}
+						for (int c = 0; c < 3; c++)
+						{
+							rgb[d][c].row(y)[x] = value[c];
+						}
+					}
+				}
+			}
+		});
+
+	// luminance and two chroma differences per direction
+	padded_mosaic lum[2], cb[2], cr[2];
+	for (int d = 0; d < 2; d++)
+	{
+		lum[d].resize(width, height);
+		cb[d].resize(width, height);
+		cr[d].resize(width, height);
+		for (int y = 0; y < height; y++)
+		{
+			const float* r = rgb[d][0].row(y);
+			const float* g = rgb[d][1].row(y);
+			const float* b = rgb[d][2].row(y);
+			float* l = lum[d].row(y);
+			float* u = cb[d].row(y);
+			float* v = cr[d].row(y);
+			for (int x = 0; x < width; x++)
+			{
+				l[x] = 0.299f * r[x] + 0.587f * g[x] + 0.114f * b[x];
+				u[x] = b[x] - l[x];
+				v[x] = r[x] - l[x];
+			}
+		}
+		lum[d].mirror_borders();
+		cb[d].mirror_borders();
+		cr[d].mirror_borders();
+	}
+
+	// homogeneity: neighbours closer than the tighter of the two directional tolerances
+	padded_mosaic homogeneity[2];
+	homogeneity[0].resize(width, height);
+	homogeneity[1].resize(width, height);
+	const ptrdiff_t neighbours[4] = { -1, 1, -stride, stride };
+
+	parallel_rows(height, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				const float* lh = lum[0].row(y);
+				const float* lv = lum[1].row(y);
+				for (int x = 0; x < width; x++)
+				{
+					const float eps_l = std::min(std::max(std::fabs(lh[x] - lh[x - 1]), std::fabs(lh[x] - lh[x + 1])),
+						std::max(std::fabs(lv[x] - lv[x - stride]), std::fabs(lv[x] - lv[x + stride])));
+
+					auto chroma = [&](int d, ptrdiff_t n)
+					{
+						const float du = cb[d].row(y)[x] - cb[d].row(y)[x + n];
+						const float dv = cr[d].row(y)[x] - cr[d].row(y)[x + n];
+						return du * du + dv * dv;
+					};
+					const float eps_c = std::min(std::max(chroma(0, -1), chroma(0, 1)), std::max(chroma(1, -stride), chroma(1, stride)));
+
+					for (int d = 0; d < 2; d++)
+					{
+						const float* l = lum[d].row(y);
+						int count = 0;
+						for (ptrdiff_t n : neighbours)
+						{
+							if (std::fabs(l[x] - l[x + n]) <= eps_l && chroma(d, n) <= eps_c)
+							{
+								count++;
+							}
+						}
+						homogeneity[d].row(y)[x] = (float)count;
+					}
+				}
+			}
+		});
+	homogeneity[0].mirror_borders();
+	homogeneity[1].mirror_borders();
+
+	parallel_rows(height, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				for (int x = 0; x < width; x++)
+				{
+					float score[2] = { 0.0f, 0.0f };
+					for (int d = 0; d < 2; d++)
+					{
+						for (int dy = -1; dy <= 1; dy++)
+						{
+							const float* h = homogeneity[d].row(y + dy);
+							score[d] += h[x - 1] + h[x] + h[x + 1];
+						}
+					}
+					for (int c = 0; c < 3; c++)
+					{
+						const float a = rgb[0][c].row(y)[x], b = rgb[1][c].row(y)[x];
+						out.row(y, c)[x] = score[0] > score[1] ? a : (score[1] > score[0] ? b : (a + b) * 0.5f);
+					}
+				}
+			}
+		});
+}
+
+void demosaic_bayer(const padded_mosaic& mosaic, bayer_pattern pattern, demosaic_mode mode, image<float, pixel_layout::planar>& out)
+{
+	if (out.width() != mosaic.width || out.height() != mosaic.height)
+	{
+		out.resize(mosaic.width, mosaic.height);
+	}
+
+	switch (mode)
+	{
+	case demosaic_mode::bilinear:
+		demosaic_linear(mosaic, phase_table(pattern, bilinear_stencils), out);
+		break;
+	case demosaic_mode::malvar:
+		demosaic_linear(mosaic, phase_table(pattern, malvar_stencils), out);
+		break;
+	case demosaic_mode::ahd:
+		demosaic_ahd(mosaic, pattern, out);
+		break;
+	}
+}
+
+// Integer copy of a phase table, weights in sixteenths. Every bilinear and Malvar weight is a
+// multiple of 1/16, so the conversion is exact.
+struct fixed_phase_table
+{
+	int count[2][3];
+	int dx[2][3][25], dy[2][3][25];
+	int16_t weight[2][3][25][2];
+
+	explicit fixed_phase_table(const phase_table& table)
+	{
+		for (int p = 0; p < 2; p++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				const row_taps& taps = table.taps[p][c];
+				count[p][c] = taps.count;
+				for (int t = 0; t < taps.count; t++)
+				{
+					dx[p][c][t] = taps.dx[t];
+					dy[p][c][t] = taps.dy[t];
+					weight[p][c][t][0] = static_cast<int16_t>(std::lround(taps.weight[t][0] * 16.0f));
+					weight[p][c][t][1] = static_cast<int16_t>(std::lround(taps.weight[t][1] * 16.0f));
+				}
+			}
+		}
+	}
+};
+
+void demosaic_bayer_fixed(const padded_plane<uint8_t>& mosaic, bayer_pattern pattern, demosaic_mode mode, image<uint8_t, pixel_layout::planar>& out)
+{
+	if (out.width() != mosaic.width || out.height() != mosaic.height)
+	{
+		out.resize(mosaic.width, mosaic.height);
+	}
+
+	const fixed_phase_table table(phase_table(pattern, mode == demosaic_mode::bilinear ? bilinear_stencils : malvar_stencils));
+	const int width = mosaic.width;
+	const int pairs = width / 2;
+	const ptrdiff_t stride = mosaic.stride;
+
+	parallel_rows(mosaic.height, [&](int first, int last)
+		{
+			// sum of 255 times the absolute weights stays below 10200 for every stencil, so int16 never overflows
+			std::vector <int16_t> sums(width);
+			for (int y = first; y < last; y++)
+			{
+				const uint8_t* center = mosaic.row(y);
+				for (int c = 0; c < 3; c++)
+				{
+					const int p = y & 1;
+					int16_t* __restrict acc = sums.data();
+					std::fill(acc, acc + width, int16_t(0));
+					for (int t = 0; t < table.count[p][c]; t++)
+					{
+						const uint8_t* __restrict src = center + table.dy[p][c][t] * stride + table.dx[p][c][t];
+						const int16_t even = table.weight[p][c][t][0], odd = table.weight[p][c][t][1];
+						for (int i = 0; i < pairs; i++)
+						{
+							acc[2 * i] += even * src[2 * i];
+							acc[2 * i + 1] += odd * src[2 * i + 1];
+						}
+						if (width & 1)
+						{
+							acc[width - 1] += even * src[width - 1];
+						}
+					}
+					uint8_t* __restrict dst = out.row(y, c);
+					for (int x = 0; x < width; x++)
+					{
+						const int v = (acc[x] + 8) >> 4;
+						dst[x] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+					}
+				}
+			}
+		});
+}
+
+
+// Taps of one X-Trans phase and channel, the nearest ring of sites of that colour weighted by inverse square distance
+struct xtrans_taps
+{
+	int count;
+	int dx[24], dy[24];
+	float weight[24];
+};
+
+struct xtrans_table
+{
+	xtrans_taps taps[6][6][3];
+	// smallest row / column of the pattern with the same colours, used to pick border pixels
+	int row_class[6], column_class[6];
+};
+
+constexpr xtrans_table make_xtrans_table()
+{
+	xtrans_table table{};
+
+	for (int y = 0; y < 6; y++)
+	{
+		for (int x = 0; x < 6; x++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				xtrans_taps& taps = table.taps[y][x][c];
+				for (int ring = 0; ring <= 2 && taps.count == 0; ring++)
+				{
+					float total = 0.0f;
+					for (int dy = -ring; dy <= ring; dy++)
+					{
+						for (int dx = -ring; dx <= ring; dx++)
+						{
+							const bool on_ring = dx == ring || dx == -ring || dy == ring || dy == -ring;
+							if (!on_ring || xtrans_pattern[(y + dy + 6) % 6][(x + dx + 6) % 6] != c)
+							{
+								continue;
+							}
+							const float weight = ring == 0 ? 1.0f : 1.0f / (dx * dx + dy * dy);
+							taps.dx[taps.count] = dx;
+							taps.dy[taps.count] = dy;
+							taps.weight[taps.count] = weight;
+							taps.count++;
+							total += weight;
+						}
+					}
+					for (int t = 0; t < taps.count; t++)
+					{
+						taps.weight[t] /= total;
+					}
+				}
+			}
+		}
+	}
+
+	for (int i = 0; i < 6; i++)
+	{
+		table.row_class[i] = i;
+		table.column_class[i] = i;
+		for (int j = i - 1; j >= 0; j--)
+		{
+			bool same_row = true, same_column = true;
+			for (int k = 0; k < 6; k++)
+			{
+				same_row = same_row && xtrans_pattern[i][k] == xtrans_pattern[j][k];
+				same_column = same_column && xtrans_pattern[k][i] == xtrans_pattern[k][j];
+			}
+			if (same_row)
+			{
+				table.row_class[i] = j;
+			}
+			if (same_column)
+			{
+				table.column_class[i] = j;
+			}
+		}
+	}
+
+	return table;
+}
+
+static constexpr xtrans_table xtrans = make_xtrans_table();
+
+constexpr bool xtrans_complete()
+{
+	for (int y = 0; y < 6; y++)
+	{
+		for (int x = 0; x < 6; x++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				if (xtrans.taps[y][x][c].count == 0)
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static_assert(xtrans_complete(), "every X-Trans phase needs a site of each colour within two pixels");
+
+// in image row / column of the same X-Trans class nearest to i, clamped when the image is smaller than the pattern
+static int xtrans_source(int i, int n, const int* classes)
+{
+	const int wanted = classes[((i % 6) + 6) % 6];
+	const int start = i < 0 ? 0 : n - 1;
+	const int step = i < 0 ? 1 : -1;
+	for (int s = start; s >= 0 && s < n; s += step)
+	{
+		if (classes[s % 6] == wanted)
+		{
+			return s;
+		}
+	}
+	return start;
+}
+
+void xtrans_borders(padded_mosaic& mosaic)
+{
+	const int border = padded_mosaic::border;
+
+	for (int y = 0; y < mosaic.height; y++)
+	{
+		float* r = mosaic.row(y);
+		for (int x = 1; x <= border; x++)
+		{
+			r[-x] = r[xtrans_source(-x, mosaic.width, xtrans.column_class)];
+			r[mosaic.width - 1 + x] = r[xtrans_source(mosaic.width - 1 + x, mosaic.width, xtrans.column_class)];
+		}
+	}
+	for (int y = 1; y <= border; y++)
+	{
+		const float* top = mosaic.row(xtrans_source(-y, mosaic.height, xtrans.row_class)) - border;
+		const float* bottom = mosaic.row(xtrans_source(mosaic.height - 1 + y, mosaic.height, xtrans.row_class)) - border;
+		std::copy(top, top + mosaic.stride, mosaic.row(-y) - border);
+		std::copy(bottom, bottom + mosaic.stride, mosaic.row(mosaic.height - 1 + y) - border);
+	}
+}
+
+// out[x] = base[x] + sum of weight * (a - b) over the taps, for every sixth x starting at phase
+static void xtrans_apply(const xtrans_taps& taps, const float* base, const float* a, const float* b, ptrdiff_t stride, float* out, int phase, int width)
+{
+	for (int x = phase; x < width; x += 6)
+	{
+		float sum = base == nullptr ? 0.0f : base[x];
+		for (int t = 0; t < taps.count; t++)
+		{
+			const ptrdiff_t offset = x + taps.dy[t] * stride + taps.dx[t];
+			sum += taps.weight[t] * (b == nullptr ? a[offset] : a[offset] - b[offset]);
+		}
+		out[x] = sum;
+	}
+}
+
+void demosaic_xtrans(const padded_mosaic& mosaic, image<float, pixel_layout::planar>& out)
+{
+	const int width = mosaic.width;
+	const ptrdiff_t stride = mosaic.stride;
+
+	if (out.width() != width || out.height() != mosaic.height)
+	{
+		out.resize(width, mosaic.height);
+	}
+
+	// green is dense enough in every 3x3 to be interpolated on its own
+	padded_mosaic green;
+	green.resize(width, mosaic.height);
+	parallel_rows(mosaic.height, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				for (int phase = 0; phase < 6; phase++)
+				{
+					xtrans_apply(xtrans.taps[y % 6][phase][1], nullptr, mosaic.row(y), nullptr, stride, green.row(y), phase, width);
+				}
+			}
+		});
+	xtrans_borders(green);
+
+	// red and blue follow green through the colour difference, at their own sites the difference is exact
+	parallel_rows(mosaic.height, [&](int first, int last)
+		{
+			for (int y = first; y < last; y++)
+			{
+				const float* g = green.row(y);
+				std::copy(g, g + width, out.row(y, 1));
+				for (int c = 0; c < 3; c += 2)
+				{
+					for (int phase = 0; phase < 6; phase++)
+					{
+						xtrans_apply(xtrans.taps[y % 6][phase][c], g, mosaic.row(y), g, stride, out.row(y, c), phase, width);
+					}
+				}
+			}
+		});
+}
+
+// Bayer stencils read every colour of the 2 x 2 cell, a single row or column lacks some of them
+static bool bayer_size_ok(const mosaic_image& mosaic)
+{
+	return mosaic.width() >= 2 && mosaic.height() >= 2;
+}
+
+bool demosaic(const mosaic_image& mosaic, demosaic_mode mode, image<float, pixel_layout::planar>& out)
+{
+	PROFILE_SCOPE("demosaic");
+	const cfa_descriptor& cfa = mosaic.cfa();
+	if (cfa.layout == cfa_layout::bayer && !bayer_size_ok(mosaic))
+	{
+		std::cout << "Mosaic too small" << "\n";
+		return false;
+	}
+
+	padded_mosaic padded;
+	std::visit([&](const auto& samples)
+		{
+			load_mosaic(samples.data(), mosaic.width(), mosaic.width(), mosaic.height(), padded, cfa.white_level);
+		}, mosaic.samples());
+
+	if (cfa.layout == cfa_layout::xtrans)
+	{
+		xtrans_borders(padded);
+		demosaic_xtrans(padded, out);
+	}
+	else
+	{
+		demosaic_bayer(padded, cfa.pattern, mode, out);
+	}
+	return true;
+}
+
+bool demosaic_fixed(const mosaic_image& mosaic, demosaic_mode mode, image<uint8_t, pixel_layout::planar>& out)
+{
+	PROFILE_SCOPE("demosaic_fixed");
+	const cfa_descriptor& cfa = mosaic.cfa();
+	if (cfa.layout != cfa_layout::bayer || !bayer_size_ok(mosaic) || mode == demosaic_mode::ahd || mosaic.bits() != 8 || (cfa.white_level != 0 && cfa.white_level != 255))
+	{
+		return false;
+	}
+
+	const std::vector <uint8_t>& samples = std::get<std::vector <uint8_t>>(mosaic.samples());
+	padded_plane<uint8_t> padded;
+	padded.resize(mosaic.width(), mosaic.height());
+	for (int y = 0; y < mosaic.height(); y++)
+	{
+		const uint8_t* in = samples.data() + static_cast<size_t>(y) * mosaic.width();
+		std::copy(in, in + mosaic.width(), padded.row(y));
+	}
+	padded.mirror_borders();
+
+	demosaic_bayer_fixed(padded, cfa.pattern, mode, out);
+	return true;
+}
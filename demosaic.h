@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+#include "image.h"
+#include "mosaic.h"
+
+enum class demosaic_mode
+{
+	bilinear, // fastest, soft edges and zippering
+	malvar, // Malvar-He-Cutler gradient corrected 5x5 stencils
+	ahd // adaptive homogeneity-directed, picks horizontal or vertical green per pixel
+};
+
+// Mosaic plane with a border of `border` mirrored pixels on every side.
+// Mirroring by an even distance keeps every border pixel on the right colour of the pattern,
+// as long as the plane is at least 2 x 2: a single row or column has no pixel of the same
+// colour one step away to mirror, Bayer mosaics that small are turned down by demosaic.
+template <typename T>
+struct padded_plane
+{
+	static const int border = 2;
+	int width = 0, height = 0;
+	ptrdiff_t stride = 0;
+	std::vector <T> samples;
+
+	const T* row(int y) const { return samples.data() + (y + border) * stride + border; }
+	T* row(int y) { return samples.data() + (y + border) * stride + border; }
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		stride = w + 2 * border;
+		samples.assign(static_cast<size_t>(stride) * (h + 2 * border), T());
+	}
+
+	void mirror_borders()
+	{
+		for (int y = 0; y < height; y++)
+		{
+			T* r = row(y);
+			for (int x = 1; x <= border; x++)
+			{
+				r[-x] = r[mirror_index(-x, width)];
+				r[width - 1 + x] = r[mirror_index(width - 1 + x, width)];
+			}
+		}
+		for (int y = 1; y <= border; y++)
+		{
+			const T* top = row(mirror_index(-y, height)) - border;
+			const T* bottom = row(mirror_index(height - 1 + y, height)) - border;
+			std::copy(top, top + stride, row(-y) - border);
+			std::copy(bottom, bottom + stride, row(height - 1 + y) - border);
+		}
+	}
+};
+
+// Samples as floats in 0.0 - 1.0
+using padded_mosaic = padded_plane<float>;
+
+// white_level is the raw value of full scale, 0 for the whole range of T
+template <typename T>
+void load_mosaic(const T* mosaic, ptrdiff_t stride, int width, int height, padded_mosaic& out, int white_level = 0)
+{
+	const float scale = 1.0f / (white_level > 0 ? white_level : static_cast<float>(sample_traits<T>::max_value));
+	out.resize(width, height);
+	for (int y = 0; y < height; y++)
+	{
+		const T* in = mosaic + y * stride;
+		float* row = out.row(y);
+		for (int x = 0; x < width; x++)
+		{
+			row[x] = in[x] * scale;
+		}
+	}
+	out.mirror_borders();
+}
+
+// Full colour reconstruction of a Bayer mosaic into three planes of out (resized to fit)
+void demosaic_bayer(const padded_mosaic& mosaic, bayer_pattern pattern, demosaic_mode mode, image<float, pixel_layout::planar>& out);
+
+template <typename T>
+void demosaic_bayer(const T* mosaic, ptrdiff_t stride, int width, int height, bayer_pattern pattern, demosaic_mode mode, image<float, pixel_layout::planar>& out)
+{
+	padded_mosaic padded;
+	load_mosaic(mosaic, stride, width, height, padded);
+	demosaic_bayer(padded, pattern, mode, out);
+}
+
+// Fills the border of a mosaic with pixels of the same colour from near the edge, mirroring
+// would put the wrong colours there as the X-Trans layout is not symmetric at every edge
+void xtrans_borders(padded_mosaic& mosaic);
+
+// Full colour reconstruction of an X-Trans mosaic, green first, then red and blue from colour differences
+void demosaic_xtrans(const padded_mosaic& mosaic, image<float, pixel_layout::planar>& out);
+
+template <typename T>
+void demosaic_xtrans(const T* mosaic, ptrdiff_t stride, int width, int height, image<float, pixel_layout::planar>& out)
+{
+	padded_mosaic padded;
+	load_mosaic(mosaic, stride, width, height, padded);
+	xtrans_borders(padded);
+	demosaic_xtrans(padded, out);
+}
+
+// Demosaics with the engine its CFA descriptor asks for, mode only matters for Bayer mosaics.
+// False for a Bayer mosaic without a whole 2 x 2 cell, out is left as it was.
+bool demosaic(const mosaic_image& mosaic, demosaic_mode mode, image<float, pixel_layout::planar>& out);
+
+// Integer only Bayer demosaic of 8 bit samples: the bilinear and Malvar stencils are exact in
+// sixteenths, so every output is one int16 multiply-add per tap, a rounding shift and a clamp.
+// The result is the float path rounded to bytes, at most one step off.
+void demosaic_bayer_fixed(const padded_plane<uint8_t>& mosaic, bayer_pattern pattern, demosaic_mode mode, image<uint8_t, pixel_layout::planar>& out);
+
+// 8 bit Bayer mosaics of at least 2 x 2 with a full range white level in bilinear or Malvar
+// mode only, false otherwise
+bool demosaic_fixed(const mosaic_image& mosaic, demosaic_mode mode, image<uint8_t, pixel_layout::planar>& out);
@@ -0,0 +1,106 @@
+#include "bitmap.h"
+#include "mosaic.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+// The integer paths of rescale and demosaic against the float ones on random 8 bit images:
+// both round to nearest, so no sample may differ by more than one step.
+static const int max_error = 1;
+
+static int max_difference(const bitmap& a, const bitmap& b)
+{
+	int worst = 0;
+	for (int y = 0; y < a.m_height; y++)
+	{
+		for (int x = 0; x < a.m_width; x++)
+		{
+			const color3f p = a.get_color(x, y), q = b.get_color(x, y);
+			const double channels[3][2] = { { p.r, q.r }, { p.g, q.g }, { p.b, q.b } };
+			for (const auto& pair : channels)
+			{
+				worst = std::max(worst, std::abs((int)std::lround(pair[0] * 255.0) - (int)std::lround(pair[1] * 255.0)));
+			}
+		}
+	}
+	return worst;
+}
+
+static bool check(const char* what, int width, int height, int error)
+{
+	if (error > max_error)
+	{
+		std::cout << what << " " << width << "x" << height << ": off by " << error << " steps" << "\n";
+		return false;
+	}
+	return true;
+}
+
+int main()
+{
+	std::mt19937 random(19);
+	bool passed = true;
+
+	const int sources[][2] = { { 97, 61 }, { 256, 256 } };
+	const resample_kernel kernels[] = { resample_kernel::catmull_rom, resample_kernel::mitchell, resample_kernel::lanczos3 };
+	const char* kernel_names[] = { "catmull_rom", "mitchell", "lanczos3" };
+	// from 1/16, the largest reduction the integer path takes, up to 2x
+	const double scales[] = { 1.0 / 16, 0.1, 0.3, 0.5, 0.77, 1.0, 1.3, 2.0 };
+
+	for (const auto& size : sources)
+	{
+		for (pixel_format format : { pixel_format::rgb8, pixel_format::rgb8_planar })
+		{
+			bitmap source(size[0], size[1], "source.bmp", format);
+			for (int y = 0; y < size[1]; y++)
+			{
+				for (int x = 0; x < size[0]; x++)
+				{
+					source.set_color(color3f((random() & 255) / 255.0, (random() & 255) / 255.0, (random() & 255) / 255.0), x, y);
+				}
+			}
+
+			for (int k = 0; k < 3; k++)
+			{
+				for (double scale : scales)
+				{
+					const int width = std::max(1, (int)std::ceil(size[0] * scale));
+					const int height = std::max(1, (int)std::ceil(size[1] * scale));
+					const bitmap reference = source.rescale(width, height, kernels[k]);
+					const bitmap fixed = source.rescale(width, height, kernels[k], false, true);
+					passed &= check(kernel_names[k], width, height, max_difference(reference, fixed));
+				}
+			}
+		}
+	}
+
+	const int mosaics[][2] = { { 64, 48 }, { 37, 23 }, { 2, 2 } };
+	const bayer_pattern patterns[] = { bayer_pattern::rggb, bayer_pattern::bggr, bayer_pattern::grbg, bayer_pattern::gbrg };
+
+	for (const auto& size : mosaics)
+	{
+		for (bayer_pattern pattern : patterns)
+		{
+			cfa_descriptor cfa;
+			cfa.pattern = pattern;
+			mosaic_image mosaic(size[0], size[1], 8, cfa);
+			for (uint8_t& sample : std::get<std::vector <uint8_t>>(mosaic.samples()))
+			{
+				sample = (uint8_t)(random() & 255);
+			}
+
+			for (demosaic_mode mode : { demosaic_mode::bilinear, demosaic_mode::malvar })
+			{
+				bitmap reference(0, 0, "reference.bmp"), fixed(0, 0, "fixed.bmp");
+				reference.demosaic(mosaic, mode);
+				fixed.demosaic(mosaic, mode, true);
+				passed &= check(mode == demosaic_mode::bilinear ? "bilinear demosaic" : "malvar demosaic", size[0], size[1], max_difference(reference, fixed));
+			}
+		}
+	}
+
+	std::cout << (passed ? "fixed point paths within one step of the float paths" : "fixed point paths off") << "\n";
+	return passed ? 0 : 1;
+}
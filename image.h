@@ -0,0 +1,208 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <type_traits>
+#include "transpose.h"
+
+// How the three colour channels are arranged in memory
+enum class pixel_layout
+{
+	interleaved, // r g b r g b ... one row after another
+	planar // whole red plane, then green plane, then blue plane
+};
+
+// Range of a sample type, colours outside of image are always 0.0 - 1.0
+template <typename T>
+struct sample_traits;
+
+template <>
+struct sample_traits <uint8_t>
+{
+	static constexpr bool is_integer = true;
+	static constexpr double max_value = 255.0;
+};
+
+template <>
+struct sample_traits <uint16_t>
+{
+	static constexpr bool is_integer = true;
+	static constexpr double max_value = 65535.0;
+};
+
+template <>
+struct sample_traits <float>
+{
+	static constexpr bool is_integer = false;
+	static constexpr double max_value = 1.0;
+};
+
+template <typename T>
+inline T to_sample(double value)
+{
+	if constexpr (sample_traits<T>::is_integer)
+	{
+		if (value <= 0.0)
+		{
+			return 0;
+		}
+		if (value >= 1.0)
+		{
+			return static_cast<T>(sample_traits<T>::max_value);
+		}
+		return static_cast<T>(value * sample_traits<T>::max_value + 0.5);
+	}
+	else
+	{
+		return static_cast<T>(value);
+	}
+}
+
+template <typename T>
+inline double from_sample(T sample)
+{
+	if constexpr (sample_traits<T>::is_integer)
+	{
+		return static_cast<double>(sample) / sample_traits<T>::max_value;
+	}
+	else
+	{
+		return static_cast<double>(sample);
+	}
+}
+
+template <typename D, typename S>
+inline D convert_sample(S sample)
+{
+	if constexpr (std::is_same<S, D>::value)
+	{
+		return sample;
+	}
+	else
+	{
+		return to_sample<D>(from_sample<S>(sample));
+	}
+}
+
+// Three channel image with typed samples, channel 0 = red, 1 = green, 2 = blue
+template <typename T, pixel_layout L = pixel_layout::interleaved>
+class image
+{
+public:
+	using sample_type = T;
+	static constexpr pixel_layout layout = L;
+	static constexpr int channels = 3;
+	// distance between two neighbouring pixels of the same channel
+	static constexpr int pixel_stride = L == pixel_layout::interleaved ? channels : 1;
+
+	image() : m_width(0), m_height(0) {}
+	image(int width, int height) : m_width(width), m_height(height), m_samples(static_cast<size_t>(width) * height * channels) {}
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+	size_t size_bytes() const { return m_samples.size() * sizeof(T); }
+
+	void resize(int width, int height)
+	{
+		m_width = width;
+		m_height = height;
+		m_samples.assign(static_cast<size_t>(width) * height * channels, T());
+	}
+
+	// first sample of channel c in row y, step by pixel_stride to get to the next pixel
+	T* row(int y, int c = 0)
+	{
+		return m_samples.data() + offset(0, y, c);
+	}
+	const T* row(int y, int c = 0) const
+	{
+		return m_samples.data() + offset(0, y, c);
+	}
+
+	T& at(int x, int y, int c)
+	{
+		return m_samples[offset(x, y, c)];
+	}
+	const T& at(int x, int y, int c) const
+	{
+		return m_samples[offset(x, y, c)];
+	}
+
+	double get(int x, int y, int c) const
+	{
+		return from_sample<T>(at(x, y, c));
+	}
+	void set(int x, int y, int c, double value)
+	{
+		at(x, y, c) = to_sample<T>(value);
+	}
+
+	T* data() { return m_samples.data(); }
+	const T* data() const { return m_samples.data(); }
+
+private:
+	size_t offset(int x, int y, int c) const
+	{
+		if constexpr (L == pixel_layout::interleaved)
+		{
+			return (static_cast<size_t>(y) * m_width + x) * channels + c;
+		}
+		else
+		{
+			return (static_cast<size_t>(c) * m_height + y) * m_width + x;
+		}
+	}
+
+	int m_width;
+	int m_height;
+	std::vector <T> m_samples;
+};
+
+// Index of a mirrored border sample, i reflected at 0 and n - 1 without repeating the edge
+inline int mirror_index(int i, int n)
+{
+	if (n == 1)
+	{
+		return 0;
+	}
+	while (i < 0 || i >= n)
+	{
+		i = i < 0 ? -i : 2 * (n - 1) - i;
+	}
+	return i;
+}
+
+// Copies src into dst (same size) converting sample type and layout row by row
+template <typename D, pixel_layout DL, typename S, pixel_layout SL>
+void convert_image(const image<S, SL>& src, image<D, DL>& dst)
+{
+	if constexpr (std::is_same<S, D>::value && SL != DL)
+	{
+		// r g b triplets <-> three planes is a transpose of a pixels x 3 array
+		const int pixels = src.width() * src.height();
+		if (SL == pixel_layout::interleaved)
+		{
+			transpose(src.data(), dst.data(), pixels, 3);
+		}
+		else
+		{
+			transpose(src.data(), dst.data(), 3, pixels);
+		}
+		return;
+	}
+
+	const int width = src.width();
+	for (int c = 0; c < 3; c++)
+	{
+		for (int y = 0; y < src.height(); y++)
+		{
+			const S* in = src.row(y, c);
+			D* out = dst.row(y, c);
+			for (int x = 0; x < width; x++)
+			{
+				out[x * image<D, DL>::pixel_stride] = convert_sample<D>(in[x * image<S, SL>::pixel_stride]);
+			}
+		}
+	}
+}
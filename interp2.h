@@ -28,6 +28,8 @@
 #include <cmath>
 #include <assert.h>
 #include <initializer_list>
+#include <cstring>
+#include "interpolate.h"
 
 //#define DO_NOT_USE_EIGEN
 
@@ -210,168 +212,69 @@ inline void Matrix<T>::resize (int r, int c)
 }
 #endif
 
+// Resamples in into out with the taps of policy P (see interpolate.h). The row and column taps
+// are computed once, output pixel centres map onto input pixel centres.
+template<typename P, typename T>
+void interpolate_matrix (const Matrix<T>& in, Matrix<T>& out)
+{
+  constexpr int taps = P::taps;
+  interpolation_axis rows, cols;
+  rows.compute<P> (in.rows (), out.rows ());
+  cols.compute<P> (in.cols (), out.cols ());
+
+  // column order, the way the values are stored
+  for (int j = 0; j < out.cols (); j++)
+  {
+    const int* cj = &cols.index[j * taps];
+    const float* wj = &cols.weight[j * taps];
+    for (int i = 0; i < out.rows (); i++)
+    {
+      const int* ri = &rows.index[i * taps];
+      const float* wi = &rows.weight[i * taps];
+      double v = 0;
+      for (int b = 0; b < taps; b++)
+      {
+        double part = 0;
+        for (int a = 0; a < taps; a++)
+          part += wi[a] * in (ri[a], cj[b]);
+        v += wj[b] * part;
+      }
+      out (i, j) = (T)v;
+    }
+  }
+}
+
 // Nearest neighbor interpolation
 template<typename T>
 void nni (const Matrix<T>& in, Matrix<T>& out)
 {
-  //scaling factors
-  double xr = (double)out.cols () / (in.cols ()-1);
-  double yr = (double)out.rows () / (in.rows ()-1);
-
-  assert (xr >= 1 && yr >= 1);
-
-  for (int i = 0; i < out.rows (); i++)
-    for (int j = 0; j < out.cols (); j++)
-      out (i, j) = in (lround(i / yr), lround(j / xr));
+  interpolate_matrix<nearest_policy> (in, out);
 }
 
 // Bilinear interpolation
 template<typename T>
 void bilin (const Matrix<T>& in, Matrix<T>& out)
 {
-  //scaling factors
-  double xr = (double)out.cols () / (in.cols ()-1);
-  double yr = (double)out.rows () / (in.rows ()-1);
-
-  assert (xr >= 1 && yr >= 1);
-
-  for (int i = 0; i < out.rows (); i++)
-  {
-    int ii = (int)floor (i / xr);
-    for (int j = 0; j < out.cols (); j++)
-    {
-      int jj = (int)floor (j / yr);
-      T v00 = in (ii, jj), v01 = in (ii, jj + 1),
-        v10 = in (ii + 1, jj), v11 = in (ii + 1, jj + 1);
-      double fi = i / xr - ii, fj = j / yr - jj;
-      out (i, j) = (1 - fi) * (1 - fj) * v00 + (1 - fi) * fj * v01 +
-        fi * (1 - fj) * v10 + fi * fj * v11;
-    }
-  }
+  interpolate_matrix<bilinear_policy> (in, out);
 }
 
 // Biquadratic interpolation
 template<typename T>
 void biquad (const Matrix<T>& in, Matrix<T>& out)
 {
-  //scaling factors
-  double xr = (double)out.cols () / (in.cols () - 1);
-  double yr = (double)out.rows () / (in.rows () - 1);
-
-  assert (xr >= 1 && yr >= 1);
-  auto qterp = [](double t, T a0, T a1, T a2)->T {
-    return a0 + t * (a1 - a0) + 0.5 * t * (t - 1) * (a2 - 2 * a1 + a0); };
-  for (int i = 0; i < out.rows (); i++)
-  {
-    int ii = (int)floor (i / xr);
-    if (ii == in.rows () - 2)
-      ii--;
-    double fi = i / xr - ii;
-    for (int j = 0; j < out.cols (); j++)
-    {
-      int jj = (int)floor (j / yr);
-      if (jj == in.cols () - 2)
-        jj--;
-      double fj = j / yr - jj;
-      T cols[3] = { qterp (fi, in (ii,jj), in (ii + 1, jj), in (ii + 2, jj)),
-                 qterp (fi, in (ii, jj + 1), in (ii + 1, jj + 1), in (ii + 2, jj + 1)),
-                 qterp (fi, in (ii, jj + 2), in (ii + 1, jj + 2), in (ii + 2, jj + 2)) };
-      out (i, j) = qterp (fj, cols[0], cols[1], cols[2]);
-    }
-  }
+  interpolate_matrix<biquadratic_policy> (in, out);
 }
 
-// Bicubic interpolation
+// Bicubic interpolation, Hermite patches with central difference slopes
 template<typename T>
 void bicube (const Matrix<T>& in, Matrix<T>& out)
 {
-  //scaling factors
-  double xr = (double)out.cols () / (in.cols () - 1);
-  double yr = (double)out.rows () / (in.rows () - 1);
-
-  //interpolation function
-  auto bic = [](double x, double y, const Matrix<T>& a) ->T {
-    double v = 0;
-    for (int i = 0; i < 4; i++)
-      for (int j = 0; j < 4; j++)
-        v += a (i, j) * pow (x, i) * pow (y, j);
-    return v;
-  };
-  //coefficients
-  static Matrix<double> w{ { 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                           { 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                           {-3, 3, 0, 0,-2,-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                           { 2,-2, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
-                           { 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0},
-                           { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0},
-                           { 0, 0, 0, 0, 0, 0, 0, 0,-3, 3, 0, 0,-2,-1, 0, 0},
-                           { 0, 0, 0, 0, 0, 0, 0, 0, 2,-2, 0, 0, 1, 1, 0, 0},
-                           {-3, 0, 3, 0, 0, 0, 0, 0,-2, 0,-1, 0, 0, 0, 0, 0},
-                           { 0, 0, 0, 0,-3, 0, 3, 0, 0, 0, 0, 0,-2, 0,-1, 0},
-                           { 9,-9,-9, 9, 6, 3,-6,-3, 6,-6, 3,-3, 4, 2, 2, 1},
-                           {-6, 6, 6,-6,-3,-3, 3, 3,-4, 4,-2, 2,-2,-2,-1,-1},
-                           { 2, 0,-2, 0, 0, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 0},
-                           { 0, 0, 0, 0, 2, 0,-2, 0, 0, 0, 0, 0, 1, 0, 1, 0},
-                           {-6, 6, 6,-6,-4,-2, 4, 2,-3, 3,-3, 3,-2,-1,-2,-1},
-                           { 4,-4,-4, 4, 2, 2,-2,-2, 2,-2, 2,-2, 1, 1, 1, 1} };
-  assert (xr >= 1 && yr >= 1);
-  for (int i = 0; i < out.rows (); i++)
-  {
-    for (int j = 0; j < out.cols (); j++)
-    {
-      int ii = (int)floor (i / xr), jj = (int)floor (j / yr);
-      // values, derivatives and cross derivatives
-      Matrix<T> b  {
-        {in (ii,jj)}, 
-        {in (ii + 1, jj)},
-        {in (ii, jj + 1)},
-        {in (ii + 1, jj + 1)},
-        {jj > 0 ? (in (ii,jj) - in (ii,jj - 1)) : 0},
-        {jj > 0 ? (in (ii + 1, jj) - in (ii + 1, jj - 1)) : 0},
-        {in (ii, jj + 1) - in (ii,jj)},
-        {in (ii + 1,jj + 1) - in (ii + 1, jj)},
-        {ii > 0 ? (in (ii, jj) - in (ii - 1, jj)) : 0},
-        {in (ii + 1, jj) - in (ii, jj)},
-        {ii > 0 ? (in (ii, jj + 1) - in (ii - 1, jj + 1)) : 0},
-        {in (ii + 1, jj + 1) - in (ii,jj + 1)},
-        {ii > 0 && jj > 0 ? in (ii, jj) - in (ii - 1, jj - 1) : 0},
-        {jj > 0 ? in (ii + 1, jj) - in (ii, jj - 1) : 0},
-        {ii > 0 ? in (ii, jj + 1) - in (ii - 1, jj) : 0},
-        {in (ii + 1, jj + 1) - in (ii, jj)}
-      };
-      Matrix<T> a = w * b;
-      a.resize (4, 4);
-      out (i, j) = bic (i / yr - ii, j / xr - jj, a);
-    }
-  }
+  interpolate_matrix<bicubic_policy> (in, out);
 }
 
 // Constrained bicubic interpolation
 template<typename T>
 void cbi (const Matrix<T>& in, Matrix<T>& out)
 {
-  //scaling factors
-  double xr = (double)out.cols () / (in.cols () - 1);
-  double yr = (double)out.rows () / (in.rows () - 1);
-
-  assert (xr >= 1 && yr >= 1);
-
-  //weighting function
-  auto w = [](double x, double y) -> double {
-    return x * x * y * y * (9 - 6 * x - 6 * y + 4 * x * y);
-  };
-  
-  for (int i = 0; i < out.rows (); i++)
-  {
-    int ii = (int)floor (i / xr);
-    for (int j = 0; j < out.cols (); j++)
-    {
-      int jj = (int)floor (j / yr);
-      T v00 = in (ii, jj), v01 = in (ii, jj + 1),
-        v10 = in (ii + 1, jj), v11 = in (ii + 1, jj + 1);
-      double fi = i / xr - ii, fj = j / yr - jj;
-      out (i, j) = w(1 - fi, 1 - fj) * v00 + w(1 - fi, fj) * v01 +
-        w(fi, 1 - fj) * v10 + w(fi, fj) * v11;
-    }
-  }
+  interpolate_matrix<constrained_bicubic_policy> (in, out);
 }
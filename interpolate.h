@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "image.h"
+#include "color.h"
+#include "thread_pool.h"
+
+// Point interpolation rules for rescaling, the methods of interp2.h as policies. Each samples
+// the source at the point an output pixel centre maps to, with `taps` source pixels per axis
+// starting `first_tap` of the point. Unlike the filtered kernels of resample.h they ignore the
+// pixels between two samples, so downscales alias, but they cost a few taps per output pixel
+// whatever the ratio: fine for previews and for upscales.
+struct nearest_policy
+{
+	static constexpr int taps = 1;
+	static int first_tap(double s) { return (int)std::floor(s + 0.5); }
+	static void weights(float, float* w) { w[0] = 1.0f; }
+};
+
+struct bilinear_policy
+{
+	static constexpr int taps = 2;
+	static int first_tap(double s) { return (int)std::floor(s); }
+	static void weights(float t, float* w)
+	{
+		w[0] = 1.0f - t;
+		w[1] = t;
+	}
+};
+
+// Quadratic through the pixel at or before the point and the two after it
+struct biquadratic_policy
+{
+	static constexpr int taps = 3;
+	static int first_tap(double s) { return (int)std::floor(s); }
+	static void weights(float t, float* w)
+	{
+		w[0] = 0.5f * (t - 1.0f) * (t - 2.0f);
+		w[1] = t * (2.0f - t);
+		w[2] = 0.5f * t * (t - 1.0f);
+	}
+};
+
+// Cubic Hermite through the two pixels around the point with central difference slopes,
+// which is Catmull-Rom
+struct bicubic_policy
+{
+	static constexpr int taps = 4;
+	static int first_tap(double s) { return (int)std::floor(s) - 1; }
+	static void weights(float t, float* w)
+	{
+		w[0] = ((-0.5f * t + 1.0f) * t - 0.5f) * t;
+		w[1] = (1.5f * t - 2.5f) * t * t + 1.0f;
+		w[2] = ((-1.5f * t + 2.0f) * t + 0.5f) * t;
+		w[3] = (0.5f * t - 0.5f) * t * t;
+	}
+};
+
+// Bilinear with smoothstep fractions, the two pixels around the point are blended without
+// overshoot and with a flat slope at each of them
+struct constrained_bicubic_policy
+{
+	static constexpr int taps = 2;
+	static int first_tap(double s) { return (int)std::floor(s); }
+	static void weights(float t, float* w)
+	{
+		w[1] = t * t * (3.0f - 2.0f * t);
+		w[0] = 1.0f - w[1];
+	}
+};
+
+// Run time choice of a policy
+enum class interpolation
+{
+	nearest,
+	bilinear,
+	biquadratic,
+	bicubic,
+	constrained_bicubic
+};
+
+// Taps of every output position along one axis, computed once per rescale: tap k of position i
+// reads source index index[i * taps + k], clamped to the image, with weight[i * taps + k].
+// Output pixel centres map onto source pixel centres as in resample_image.
+struct interpolation_axis
+{
+	int taps = 0;
+	std::vector <int> index;
+	std::vector <float> weight;
+
+	template <typename P>
+	void compute(int src_size, int dst_size)
+	{
+		taps = P::taps;
+		index.resize(static_cast<size_t>(dst_size) * taps);
+		weight.resize(static_cast<size_t>(dst_size) * taps);
+		const double scale = (double)src_size / dst_size;
+		for (int i = 0; i < dst_size; i++)
+		{
+			const double s = (i + 0.5) * scale - 0.5;
+			const int first = P::first_tap(s);
+			P::weights((float)(s - std::floor(s)), &weight[static_cast<size_t>(i) * taps]);
+			for (int k = 0; k < taps; k++)
+			{
+				index[static_cast<size_t>(i) * taps + k] = std::clamp(first + k, 0, src_size - 1);
+			}
+		}
+	}
+};
+
+// Rescales src into dst (already sized) by the point interpolation of P. The source planes
+// are read where they are, the only extra memory is the two axis tables and a few float rows
+// per thread. Each output pixel gathers its taps x taps source pixels directly, unless the
+// source row is narrow enough that blending the rows first and then the columns costs less,
+// as in upscales.
+template <typename P, typename S, pixel_layout SL, typename D, pixel_layout DL>
+void interpolate_image(const image<S, SL>& src, image<D, DL>& dst)
+{
+	constexpr int taps = P::taps;
+	constexpr int in_stride = image<S, SL>::pixel_stride;
+	const int width = dst.width(), src_width = src.width();
+	const bool separable = taps > 1 && (double)src_width + width < (double)width * taps;
+
+	interpolation_axis columns, rows;
+	columns.compute<P>(src_width, width);
+	rows.compute<P>(src.height(), dst.height());
+	// direct gathers take the column taps as sample offsets within a source row
+	if (!separable)
+	{
+		for (int& i : columns.index)
+		{
+			i *= in_stride;
+		}
+	}
+
+	parallel_rows(dst.height(), [&](int first, int last)
+		{
+			std::vector <float> buffer(static_cast<size_t>(width) * 3 + (separable ? src_width : 0));
+			float* channel[3] = { buffer.data(), buffer.data() + width, buffer.data() + 2 * width };
+			float* blended = buffer.data() + 3 * width;
+			const float scale = static_cast<float>(1.0 / sample_traits<S>::max_value);
+
+			for (int y = first; y < last; y++)
+			{
+				const int* row_index = &rows.index[static_cast<size_t>(y) * taps];
+				const float* wy = &rows.weight[static_cast<size_t>(y) * taps];
+
+				if constexpr (taps == 1)
+				{
+					// nearest copies samples, no weights and no round trip through floats
+					for (int c = 0; c < 3; c++)
+					{
+						const S* __restrict in = src.row(row_index[0], c);
+						D* __restrict out = dst.row(y, c);
+						for (int x = 0; x < width; x++)
+						{
+							out[x * image<D, DL>::pixel_stride] = convert_sample<D>(in[columns.index[x]]);
+						}
+					}
+					continue;
+				}
+
+				for (int c = 0; c < 3; c++)
+				{
+					const S* line[taps];
+					for (int j = 0; j < taps; j++)
+					{
+						line[j] = src.row(row_index[j], c);
+					}
+					const int* __restrict index = columns.index.data();
+					const float* __restrict wx = columns.weight.data();
+					float* __restrict out = channel[c];
+					if (separable)
+					{
+						float* __restrict row = blended;
+						for (int x = 0; x < src_width; x++)
+						{
+							float sum = 0.0f;
+							for (int j = 0; j < taps; j++)
+							{
+								sum += wy[j] * line[j][x * in_stride];
+							}
+							row[x] = sum * scale;
+						}
+						for (int x = 0; x < width; x++, index += taps, wx += taps)
+						{
+							float sum = 0.0f;
+							for (int k = 0; k < taps; k++)
+							{
+								sum += wx[k] * row[index[k]];
+							}
+							out[x] = sum;
+						}
+						continue;
+					}
+					for (int x = 0; x < width; x++, index += taps, wx += taps)
+					{
+						float sum = 0.0f;
+						for (int j = 0; j < taps; j++)
+						{
+							float part = 0.0f;
+							for (int k = 0; k < taps; k++)
+							{
+								part += wx[k] * line[j][index[k]];
+							}
+							sum += wy[j] * part;
+						}
+						out[x] = sum * scale;
+					}
+				}
+				store_pixels(channel, dst, y);
+			}
+		});
+}
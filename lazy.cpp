@@ -0,0 +1,385 @@
+#include "lazy.h"
+#include "warp.h"
+#include "profile.h"
+#include <algorithm>
+
+lazy_bitmap bitmap::defer() const
+{
+	return lazy_bitmap(*this);
+}
+
+lazy_bitmap::lazy_bitmap(const bitmap& source) : m_source(source)
+{
+}
+
+lazy_bitmap& lazy_bitmap::then(const operation& op)
+{
+	m_operations.push_back(op);
+	return *this;
+}
+
+lazy_bitmap& lazy_bitmap::rescale(int new_width, int new_height, resample_kernel kernel)
+{
+	operation op;
+	op.kind = operation_kind::rescale;
+	op.width = new_width;
+	op.height = new_height;
+	op.kernel = kernel;
+	return then(op);
+}
+
+lazy_bitmap& lazy_bitmap::rotate(double degree, rotate_filter filter)
+{
+	operation op;
+	op.kind = operation_kind::rotate;
+	op.degree = degree;
+	op.filter = filter;
+	return then(op);
+}
+
+lazy_bitmap& lazy_bitmap::grayscale(luma_standard standard)
+{
+	operation op;
+	op.kind = operation_kind::grayscale;
+	op.standard = standard;
+	return then(op);
+}
+
+lazy_bitmap& lazy_bitmap::to_color_space(color_space space)
+{
+	operation op;
+	op.kind = operation_kind::to_color_space;
+	op.space = space;
+	return then(op);
+}
+
+lazy_bitmap& lazy_bitmap::from_color_space(color_space space)
+{
+	operation op;
+	op.kind = operation_kind::from_color_space;
+	op.space = space;
+	return then(op);
+}
+
+// Size after op on a width x height input
+static void operation_size(const operation& op, int& width, int& height)
+{
+	if (op.kind == operation_kind::rescale)
+	{
+		width = op.width;
+		height = op.height;
+	}
+	else if (op.kind == operation_kind::rotate)
+	{
+		const int turns = right_angle_turns(op.degree);
+		if (turns < 0)
+		{
+			const rotation_frame frame = rotation_bounds(width, height, op.degree);
+			width = frame.width;
+			height = frame.height;
+		}
+		else if (turns % 2 == 1)
+		{
+			std::swap(width, height);
+		}
+	}
+}
+
+int lazy_bitmap::width() const
+{
+	int width = m_source.m_width, height = m_source.m_height;
+	for (const operation& op : m_operations)
+	{
+		operation_size(op, width, height);
+	}
+	return width;
+}
+
+int lazy_bitmap::height() const
+{
+	int width = m_source.m_width, height = m_source.m_height;
+	for (const operation& op : m_operations)
+	{
+		operation_size(op, width, height);
+	}
+	return height;
+}
+
+static void apply_point_operation(const operation& op, float* r, float* g, float* b, int width)
+{
+	switch (op.kind)
+	{
+	case operation_kind::grayscale:
+		luma_row(r, g, b, r, width, op.standard);
+		std::copy(r, r + width, g);
+		std::copy(r, r + width, b);
+		break;
+	case operation_kind::to_color_space:
+		switch (op.space)
+		{
+		case color_space::ycbcr: rgb_to_ycbcr_row(r, g, b, width, luma_standard::bt601); break;
+		case color_space::hsv: rgb_to_hsv_row(r, g, b, width); break;
+		case color_space::lab: rgb_to_lab_row(r, g, b, width); break;
+		}
+		break;
+	case operation_kind::from_color_space:
+		switch (op.space)
+		{
+		case color_space::ycbcr: ycbcr_to_rgb_row(r, g, b, width, luma_standard::bt601); break;
+		case color_space::hsv: hsv_to_rgb_row(r, g, b, width); break;
+		case color_space::lab: lab_to_rgb_row(r, g, b, width); break;
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+enum class stage_kind
+{
+	resample, // separable rescale
+	right_angle, // exact quarter turns
+	warp, // affine resample of a fused group
+	point // colour operations only
+};
+
+// One pass over the image, colour operations of point_ops run on its output rows
+struct stage
+{
+	stage_kind kind;
+	int width = 0, height = 0;
+	int source_width = 0, source_height = 0; // input size of a resample
+	resample_kernel kernel = resample_kernel::catmull_rom;
+	int turns = 0;
+	affine_transform to_source;
+	rotate_filter filter = rotate_filter::nearest;
+	std::vector <operation> point_ops;
+};
+
+// Rescales and rotations waiting to be turned into one stage
+struct geometry_group
+{
+	bool open = false;
+	bool rotates = false;
+	affine_transform to_source; // group output -> group input
+	rotate_filter filter = rotate_filter::nearest;
+	resample_kernel kernel = resample_kernel::catmull_rom;
+	int source_width = 0, source_height = 0;
+	int width = 0, height = 0;
+};
+
+// Two resamples in a row only fold into one when the size between them is at least as
+// large as both ends, a shrink drops detail the eager chain would never get back
+static bool folds(int source, int middle, int target)
+{
+	return middle >= source && middle >= target;
+}
+
+static void flush(geometry_group& group, std::vector <stage>& stages)
+{
+	if (!group.open)
+	{
+		return;
+	}
+	group.open = false;
+
+	if (!group.rotates)
+	{
+		// scales only: one separable rescale to the final size, folded into a rescale just before
+		const stage* last = stages.empty() ? nullptr : &stages.back();
+		if (last != nullptr && last->kind == stage_kind::resample && last->point_ops.empty() && last->kernel == group.kernel
+			&& folds(last->source_width, last->width, group.width) && folds(last->source_height, last->height, group.height))
+		{
+			stages.back().width = group.width;
+			stages.back().height = group.height;
+			return;
+		}
+		stage s;
+		s.kind = stage_kind::resample;
+		s.width = group.width;
+		s.height = group.height;
+		s.source_width = group.source_width;
+		s.source_height = group.source_height;
+		s.kernel = group.kernel;
+		stages.push_back(s);
+		return;
+	}
+
+	stage s;
+	s.kind = stage_kind::warp;
+	s.width = group.width;
+	s.height = group.height;
+	s.to_source = group.to_source;
+	s.filter = group.filter;
+	stages.push_back(s);
+}
+
+static std::vector <stage> plan(const std::vector <operation>& operations, int width, int height)
+{
+	std::vector <stage> stages;
+	geometry_group group;
+
+	auto extend = [&group, &width, &height](const affine_transform& to_input, int new_width, int new_height)
+	{
+		if (!group.open)
+		{
+			group = geometry_group();
+			group.open = true;
+			group.source_width = width;
+			group.source_height = height;
+		}
+		group.to_source = group.to_source * to_input;
+		group.width = width = new_width;
+		group.height = height = new_height;
+	};
+
+	for (const operation& op : operations)
+	{
+		if (op.kind == operation_kind::rescale)
+		{
+			const bool shrinks = op.width < width || op.height < height;
+			if (op.kernel != resample_kernel::catmull_rom || shrinks)
+			{
+				// a separable filter of its own, a fused one would alias or use the wrong kernel
+				flush(group, stages);
+				group = geometry_group();
+				group.open = true;
+				group.kernel = op.kernel;
+				group.source_width = width;
+				group.source_height = height;
+				group.width = width = op.width;
+				group.height = height = op.height;
+				flush(group, stages);
+				continue;
+			}
+			if (group.open && !group.rotates && !(folds(group.source_width, width, op.width) && folds(group.source_height, height, op.height)))
+			{
+				// a plain rescale would fold across the size in between
+				flush(group, stages);
+			}
+			extend(affine_transform::scale((double)width / op.width, (double)height / op.height), op.width, op.height);
+			group.filter = rotate_filter::bicubic;
+		}
+		else if (op.kind == operation_kind::rotate)
+		{
+			const int turns = right_angle_turns(op.degree);
+			if (turns == 0)
+			{
+				continue;
+			}
+			if (turns > 0 && !group.open)
+			{
+				// exact permutation, quarter turns in a row add up
+				if (!stages.empty() && stages.back().kind == stage_kind::right_angle && stages.back().point_ops.empty())
+				{
+					stages.back().turns = (stages.back().turns + turns) % 4;
+				}
+				else
+				{
+					stage s;
+					s.kind = stage_kind::right_angle;
+					s.turns = turns;
+					stages.push_back(s);
+				}
+				operation_size(op, width, height);
+				stages.back().width = width;
+				stages.back().height = height;
+				continue;
+			}
+			const rotation_frame frame = rotation_bounds(width, height, op.degree);
+			extend(affine_transform::rotation(frame), frame.width, frame.height);
+			group.rotates = true;
+			group.filter = std::max(group.filter, op.filter);
+		}
+		else
+		{
+			flush(group, stages);
+			if (!stages.empty() && (stages.back().kind == stage_kind::warp || stages.back().kind == stage_kind::point))
+			{
+				stages.back().point_ops.push_back(op);
+			}
+			else
+			{
+				stage s;
+				s.kind = stage_kind::point;
+				s.width = width;
+				s.height = height;
+				s.point_ops.push_back(op);
+				stages.push_back(s);
+			}
+		}
+	}
+	flush(group, stages);
+
+	// quarter turns that added up to a full one
+	stages.erase(std::remove_if(stages.begin(), stages.end(), [](const stage& s) { return s.kind == stage_kind::right_angle && s.turns == 0; }), stages.end());
+	return stages;
+}
+
+static bitmap run_stage(const stage& s, const bitmap& input)
+{
+	auto point_op = [&s](float* r, float* g, float* b, int width)
+	{
+		for (const operation& op : s.point_ops)
+		{
+			apply_point_operation(op, r, g, b, width);
+		}
+	};
+
+	if (s.kind == stage_kind::resample)
+	{
+		return input.rescale(s.width, s.height, s.kernel);
+	}
+
+	bitmap output(s.width, s.height, input.path, input.format());
+	std::visit([&s, &point_op](const auto& src, auto& dst)
+		{
+			if (s.kind == stage_kind::warp)
+			{
+				warp_options options;
+				options.filter = s.filter;
+				warp_image(src, dst, s.to_source, options, point_op);
+			}
+			else if (s.kind == stage_kind::point)
+			{
+				transform_pixels(src, dst, point_op);
+			}
+			else if constexpr (std::is_same<std::decay_t<decltype(src)>, std::decay_t<decltype(dst)>>::value)
+			{
+				rotate_right_angle(src, dst, s.turns);
+			}
+		}, input.storage(), output.storage());
+	return output;
+}
+
+bitmap lazy_bitmap::evaluate() const
+{
+	PROFILE_SCOPE("lazy evaluate");
+	const std::vector <stage> stages = plan(m_operations, m_source.m_width, m_source.m_height);
+	if (stages.empty())
+	{
+		return m_source;
+	}
+
+	bitmap result = run_stage(stages[0], m_source);
+	for (size_t i = 1; i < stages.size(); i++)
+	{
+		if (stages[i].kind == stage_kind::point)
+		{
+			// colour operations on pixels nobody else sees run in place
+			std::visit([&stages, i](auto& pixels)
+				{
+					transform_pixels(pixels, [&stages, i](float* r, float* g, float* b, int width)
+						{
+							for (const operation& op : stages[i].point_ops)
+							{
+								apply_point_operation(op, r, g, b, width);
+							}
+						});
+				}, result.storage());
+			continue;
+		}
+		result = run_stage(stages[i], result);
+	}
+	return result;
+}
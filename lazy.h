@@ -0,0 +1,58 @@
+#pragma once
+
+#include <vector>
+#include "bitmap.h"
+
+// One step of a deferred chain
+enum class operation_kind
+{
+	rescale,
+	rotate,
+	grayscale,
+	to_color_space,
+	from_color_space
+};
+
+struct operation
+{
+	operation_kind kind = operation_kind::grayscale;
+	int width = 0, height = 0; // rescale
+	resample_kernel kernel = resample_kernel::catmull_rom;
+	double degree = 0.0; // rotate
+	rotate_filter filter = rotate_filter::nearest;
+	luma_standard standard = luma_standard::bt601; // grayscale
+	color_space space = color_space::ycbcr; // colour spaces
+};
+
+// Records operations on a bitmap and runs them only when evaluated, with compatible steps fused:
+//	- rescales in a row become one rescale to the last size when every size in between is at
+//	  least as large as the sizes either side of it, a shrink is never folded across
+//	- a rotation together with the rescales around it becomes one affine resample, as long as
+//	  no rescale shrinks and all of them use Catmull-Rom
+//	- colour operations in a row become one pass, after a resample they run on its rows
+//	  before they are stored
+// so each pixel of every fused group is read and written once. The source must outlive the chain.
+class lazy_bitmap
+{
+public:
+	explicit lazy_bitmap(const bitmap& source);
+
+	lazy_bitmap& rescale(int new_width, int new_height, resample_kernel kernel = resample_kernel::catmull_rom);
+	lazy_bitmap& rotate(double degree, rotate_filter filter = rotate_filter::nearest);
+	lazy_bitmap& grayscale(luma_standard standard = luma_standard::bt601);
+	lazy_bitmap& to_color_space(color_space space);
+	lazy_bitmap& from_color_space(color_space space);
+	lazy_bitmap& then(const operation& op);
+
+	const std::vector <operation>& operations() const { return m_operations; }
+
+	// size the chain ends up at
+	int width() const;
+	int height() const;
+
+	bitmap evaluate() const;
+
+private:
+	const bitmap& m_source;
+	std::vector <operation> m_operations;
+};
@@ -1,4 +1,6 @@
 #include "matrix.h"
+#include <utility>
+#include "transpose.h"
 matrix::matrix()
 {
 	nc = 0;
@@ -13,20 +15,31 @@ matrix::matrix(int rows, int columns)
 	values.resize(columns * rows);
 }
 
-matrix::matrix(int rows, int columns, std::vector <double> values)
+matrix::matrix(int rows, int columns, const std::vector <double>& values)
 {
 	nc = columns;
 	nr = rows;
-	values.resize(rows * columns);
 	this->values = values;
+	this->values.resize(rows * columns);
 }
 
-matrix::matrix(const matrix&& m)
+matrix::matrix(matrix&& m) noexcept
 {
 	nc = m.nc;
 	nr = m.nr;
-	values.resize(m.values.size());
-	values = m.values;
+	values = std::move(m.values);
+	m.nc = 0;
+	m.nr = 0;
+}
+
+matrix& matrix::operator =(matrix&& m) noexcept
+{
+	nc = m.nc;
+	nr = m.nr;
+	values = std::move(m.values);
+	m.nc = 0;
+	m.nr = 0;
+	return *this;
 }
 
 matrix::~matrix()
@@ -63,8 +76,27 @@ void matrix::resize(int r, int c)
 	}
 }
 
-void matrix::set_values(std::vector<double> new_values)
+void matrix::set_values(const std::vector<double>& new_values)
 {
-	values.resize(new_values.size());
 	values = new_values;
+}
+
+matrix matrix::transposed() const
+{
+	matrix t(nc, nr);
+	// every column is one contiguous run of nr values
+	::transpose(values.data(), t.values.data(), nc, nr);
+	return t;
+}
+
+void matrix::transpose()
+{
+	if (nr == nc)
+	{
+		transpose_in_place(values.data(), nr);
+	}
+	else
+	{
+		*this = transposed();
+	}
 }
\ No newline at end of file
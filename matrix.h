@@ -7,34 +7,40 @@ class matrix
 public:
 	matrix();
 	matrix(int rows, int columns); //create empty matrix with columns and rows
-	matrix(int rows, int columns, std::vector <double> values); // create matrix with values from vector
-	matrix(const matrix&& m); // copy
+	matrix(int rows, int columns, const std::vector <double>& values); // create matrix with values from vector
+	matrix(const matrix& m) = default;
+	matrix(matrix&& m) noexcept; // move, leaves m empty
+	matrix& operator =(const matrix& m) = default;
+	matrix& operator =(matrix&& m) noexcept;
 	~matrix();
 	int columns() const;
 	int rows() const;
 	double& operator () (int i, int j);
 	const double& operator () (int i, int j) const;
 	void resize(int rows, int columns);
-	void set_values(std::vector <double> new_values);
+	void set_values(const std::vector <double>& new_values);
+	matrix transposed() const;
+	void transpose();
 private:
 	int nc;//number of columns
 	int nr;//number of rows
 	std::vector <double> values;
-	//matrix multiplication
+	//matrix multiplication, r(i, j) = sum a(i, k) * b(k, j)
 	friend matrix operator *(const matrix& a, const matrix& b)
 	{
-		double v = 0;
 		matrix r(a.rows(), b.columns());
-		for (int i = 0; i < a.rows(); i++)
-			for (int j = 0; j < b.columns(); j++)
+		for (int j = 0; j < b.columns(); j++)
+		{
+			// r(:, j) += a(:, k) * b(k, j), every pass runs down a contiguous column
+			for (int k = 0; k < a.columns(); k++)
 			{
-				for (int k = 0; k < a.columns(); k++)
+				const double bkj = b(k, j);
+				for (int i = 0; i < a.rows(); i++)
 				{
-					v += a(k, i) * b(k, j);
+					r(i, j) += a(i, k) * bkj;
 				}
-				r(i, j) = v;
-				v = 0;
 			}
+		}
 		return r;
 	}
-};
\ No newline at end of file
+};
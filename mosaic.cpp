@@ -0,0 +1,135 @@
+#include "mosaic.h"
+#include "bmp_file.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+int bayer_channel(bayer_pattern pattern, int x, int y)
+{
+	// colours of (0, 0), (1, 0), (0, 1), (1, 1)
+	static const int cells[4][4] =
+	{
+		{ 0, 1, 1, 2 }, // rggb
+		{ 2, 1, 1, 0 }, // bggr
+		{ 1, 0, 2, 1 }, // grbg
+		{ 1, 2, 0, 1 } // gbrg
+	};
+	return cells[(int)pattern][(y & 1) * 2 + (x & 1)];
+}
+
+mosaic_image::mosaic_image()
+{
+	m_width = 0;
+	m_height = 0;
+}
+
+mosaic_image::mosaic_image(int width, int height, int bits, const cfa_descriptor& cfa)
+{
+	m_width = width;
+	m_height = height;
+	m_cfa = cfa;
+	const size_t count = static_cast<size_t>(width) * height;
+	if (bits <= 8)
+	{
+		m_samples = std::vector <uint8_t>(count);
+	}
+	else
+	{
+		m_samples = std::vector <uint16_t>(count);
+	}
+}
+
+bool read_mosaic_bmp(const char* path, const cfa_descriptor& cfa, mosaic_image& out)
+{
+	mapped_file file;
+	if (!file.open(path))
+	{
+		std::cout << "File open not" << "\n";
+		return false;
+	}
+
+	bmp_header header;
+	if (!parse_bmp_header(file.data(), file.size(), header))
+	{
+		std::cout << "Bitmap the file is not" << "\n";
+		return false;
+	}
+	if (header.bits_per_pixel != 8)
+	{
+		std::cout << "Only 8 bit bitmaps are mosaics" << "\n";
+		return false;
+	}
+
+	// palette index -> luminance, a grayscale palette maps every index onto itself
+	uint8_t lookup[256] = {};
+	const unsigned char* palette = file.data() + header.palette_offset;
+	for (int i = 0; i < header.palette_size; i++)
+	{
+		const unsigned char* entry = palette + i * 4;
+		lookup[i] = static_cast<uint8_t>((entry[0] * 29u + entry[1] * 150u + entry[2] * 77u + 128u) >> 8);
+	}
+
+	out = mosaic_image(header.width, header.height, 8, cfa);
+	std::vector <uint8_t>& samples = std::get<std::vector <uint8_t>>(out.samples());
+
+	const unsigned char* pixels = file.data() + header.data_offset;
+	for (int y = 0; y < header.height; y++)
+	{
+		// row 0 is the first row stored in a bottom-up file, as for 24 bit bitmaps
+		const unsigned char* in = pixels + static_cast<size_t>(header.top_down ? header.height - 1 - y : y) * header.row_stride;
+		uint8_t* row = samples.data() + static_cast<size_t>(y) * header.width;
+		for (int x = 0; x < header.width; x++)
+		{
+			row[x] = lookup[in[x]];
+		}
+	}
+	return true;
+}
+
+bool read_mosaic_raw(const char* path, int width, int height, int bits, const cfa_descriptor& cfa, mosaic_image& out, size_t offset)
+{
+	if (width <= 0 || height <= 0 || bits <= 0 || bits > 16)
+	{
+		std::cout << "Raw size bad" << "\n";
+		return false;
+	}
+
+	mapped_file file;
+	if (!file.open(path))
+	{
+		std::cout << "File open not" << "\n";
+		return false;
+	}
+
+	const size_t bytes = static_cast<size_t>(width) * height * (bits <= 8 ? 1 : 2);
+	if (offset + bytes > file.size())
+	{
+		std::cout << "Raw file short" << "\n";
+		return false;
+	}
+
+	cfa_descriptor descriptor = cfa;
+	if (descriptor.white_level == 0 && bits != 8 && bits != 16)
+	{
+		descriptor.white_level = (1 << bits) - 1;
+	}
+
+	out = mosaic_image(width, height, bits, descriptor);
+	const unsigned char* in = file.data() + offset;
+	std::visit([in, bytes](auto& samples)
+		{
+			using T = typename std::decay_t<decltype(samples)>::value_type;
+			if constexpr (sizeof(T) == 1)
+			{
+				std::memcpy(samples.data(), in, bytes);
+			}
+			else
+			{
+				for (size_t i = 0; i < samples.size(); i++)
+				{
+					samples[i] = static_cast<T>(in[i * 2] | in[i * 2 + 1] << 8);
+				}
+			}
+		}, out.samples());
+	return true;
+}
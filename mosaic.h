@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+// Colour of the top left 2x2 cell, row 0 first
+enum class bayer_pattern
+{
+	rggb,
+	bggr,
+	grbg,
+	gbrg
+};
+
+// channel (0 = red, 1 = green, 2 = blue) sampled at (x, y)
+int bayer_channel(bayer_pattern pattern, int x, int y);
+
+// Fujifilm X-Trans 6x6 layout, row 0 first
+constexpr int xtrans_pattern[6][6] =
+{
+	{ 1, 2, 0, 1, 0, 2 },
+	{ 0, 1, 1, 2, 1, 1 },
+	{ 2, 1, 1, 0, 1, 1 },
+	{ 1, 0, 2, 1, 2, 0 },
+	{ 2, 1, 1, 0, 1, 1 },
+	{ 0, 1, 1, 2, 1, 1 }
+};
+
+inline int xtrans_channel(int x, int y)
+{
+	return xtrans_pattern[y % 6][x % 6];
+}
+
+enum class cfa_layout
+{
+	bayer,
+	xtrans
+};
+
+// Which colour filter sits over each photosite of a mosaic
+struct cfa_descriptor
+{
+	cfa_layout layout = cfa_layout::bayer;
+	bayer_pattern pattern = bayer_pattern::rggb; // bayer only
+	int white_level = 0; // largest raw value (4095 for 12 bit data), 0 means the full range of the sample type
+
+	int channel(int x, int y) const
+	{
+		return layout == cfa_layout::bayer ? bayer_channel(pattern, x, y) : xtrans_channel(x, y);
+	}
+};
+
+// Single plane straight off a sensor, one 8 or 16 bit sample per photosite, rows packed
+class mosaic_image
+{
+public:
+	using storage = std::variant <std::vector <uint8_t>, std::vector <uint16_t>>;
+
+	mosaic_image();
+	mosaic_image(int width, int height, int bits, const cfa_descriptor& cfa);
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+	int bits() const { return m_samples.index() == 0 ? 8 : 16; }
+	const cfa_descriptor& cfa() const { return m_cfa; }
+	void set_cfa(const cfa_descriptor& cfa) { m_cfa = cfa; }
+
+	// the sample vector, std::visit on it to get at the typed rows
+	storage& samples() { return m_samples; }
+	const storage& samples() const { return m_samples; }
+
+private:
+	int m_width;
+	int m_height;
+	cfa_descriptor m_cfa;
+	storage m_samples;
+};
+
+// 8 bit palettized or grayscale bitmap, every index is mapped through the luminance of its palette entry
+bool read_mosaic_bmp(const char* path, const cfa_descriptor& cfa, mosaic_image& out);
+
+// Headerless dump of width x height samples after `offset` bytes, bits up to 8 are read
+// as bytes, up to 16 as little endian 16 bit words
+bool read_mosaic_raw(const char* path, int width, int height, int bits, const cfa_descriptor& cfa, mosaic_image& out, size_t offset = 0);
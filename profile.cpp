@@ -0,0 +1,311 @@
+#include "profile.h"
+
+#if BITMAP_PROFILE
+
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+struct scope_stats
+{
+	uint64_t calls = 0;
+	int64_t nanoseconds = 0;
+	uint64_t allocations = 0;
+};
+
+struct trace_event
+{
+	const char* name;
+	int64_t start;
+	int64_t duration;
+	uint64_t allocations;
+};
+
+// Totals of one thread. Only that thread writes them, the lock is for the report reading along.
+struct thread_record
+{
+	int id = 0;
+	std::mutex mutex;
+	std::unordered_map <const char*, scope_stats> scopes;
+	std::unordered_map <const char*, uint64_t> counters;
+	std::vector <trace_event> events;
+};
+
+static std::mutex registry_mutex;
+static std::vector <std::shared_ptr <thread_record>> registry;
+static std::atomic <bool> tracing(false);
+static std::atomic <int> marker_file(-1);
+
+static int64_t now()
+{
+	static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static thread_record& this_thread_record()
+{
+	static thread_local std::shared_ptr <thread_record> record;
+	if (record == nullptr)
+	{
+		record = std::make_shared<thread_record>();
+		std::lock_guard <std::mutex> lock(registry_mutex);
+		record->id = static_cast<int>(registry.size());
+		registry.push_back(record);
+	}
+	return *record;
+}
+
+static void write_marker(const std::string& text)
+{
+#ifdef __linux__
+	const int fd = marker_file.load(std::memory_order_relaxed);
+	if (fd >= 0)
+	{
+		ssize_t written = ::write(fd, text.data(), text.size());
+		(void)written;
+	}
+#else
+	(void)text;
+#endif
+}
+
+profile_scope::profile_scope(const char* name)
+	: m_name(name)
+{
+	if (marker_file.load(std::memory_order_relaxed) >= 0)
+	{
+#ifdef __linux__
+		write_marker("B|" + std::to_string(getpid()) + "|" + name);
+#endif
+	}
+	m_allocations = thread_allocation_count();
+	m_start = now();
+}
+
+profile_scope::~profile_scope()
+{
+	const int64_t duration = now() - m_start;
+	const uint64_t allocations = thread_allocation_count() - m_allocations;
+
+	thread_record& record = this_thread_record();
+	{
+		std::lock_guard <std::mutex> lock(record.mutex);
+		scope_stats& stats = record.scopes[m_name];
+		stats.calls++;
+		stats.nanoseconds += duration;
+		stats.allocations += allocations;
+		if (tracing.load(std::memory_order_relaxed))
+		{
+			record.events.push_back({ m_name, m_start, duration, allocations });
+		}
+	}
+
+	if (marker_file.load(std::memory_order_relaxed) >= 0)
+	{
+#ifdef __linux__
+		write_marker("E|" + std::to_string(getpid()));
+#endif
+	}
+}
+
+void profile_count(const char* name, uint64_t amount)
+{
+	thread_record& record = this_thread_record();
+	std::lock_guard <std::mutex> lock(record.mutex);
+	record.counters[name] += amount;
+}
+
+static std::vector <std::shared_ptr <thread_record>> all_records()
+{
+	std::lock_guard <std::mutex> lock(registry_mutex);
+	return registry;
+}
+
+void profile_report(std::ostream& out)
+{
+	struct total
+	{
+		scope_stats sum;
+		std::map <int, int64_t> threads; // thread id -> nanoseconds
+	};
+	std::map <std::string, total> scopes;
+	std::map <std::string, uint64_t> counters;
+
+	for (const std::shared_ptr <thread_record>& record : all_records())
+	{
+		std::lock_guard <std::mutex> lock(record->mutex);
+		for (const auto& [name, stats] : record->scopes)
+		{
+			total& t = scopes[name];
+			t.sum.calls += stats.calls;
+			t.sum.nanoseconds += stats.nanoseconds;
+			t.sum.allocations += stats.allocations;
+			t.threads[record->id] += stats.nanoseconds;
+		}
+		for (const auto& [name, amount] : record->counters)
+		{
+			counters[name] += amount;
+		}
+	}
+
+	const std::ios_base::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(3);
+	out << std::left << std::setw(28) << "scope" << std::right << std::setw(10) << "calls" << std::setw(14) << "total ms" << std::setw(14) << "mean ms" << std::setw(12) << "allocs" << "\n";
+	for (const auto& [name, t] : scopes)
+	{
+		const double ms = t.sum.nanoseconds / 1e6;
+		out << std::left << std::setw(28) << name << std::right << std::setw(10) << t.sum.calls << std::setw(14) << ms
+			<< std::setw(14) << ms / t.sum.calls << std::setw(12) << t.sum.allocations << "\n";
+		if (t.threads.size() > 1)
+		{
+			for (const auto& [id, nanoseconds] : t.threads)
+			{
+				out << std::left << std::setw(28) << ("  thread " + std::to_string(id)) << std::right << std::setw(24) << nanoseconds / 1e6 << "\n";
+			}
+		}
+	}
+	if (!counters.empty())
+	{
+		out << std::left << std::setw(28) << "counter" << std::right << std::setw(20) << "total" << "\n";
+		for (const auto& [name, amount] : counters)
+		{
+			out << std::left << std::setw(28) << name << std::right << std::setw(20) << amount << "\n";
+		}
+	}
+	out << std::left << std::setw(28) << "allocations" << std::right << std::setw(20) << profile_allocations() << "\n";
+	out.flags(flags);
+}
+
+void profile_reset()
+{
+	for (const std::shared_ptr <thread_record>& record : all_records())
+	{
+		std::lock_guard <std::mutex> lock(record->mutex);
+		record->scopes.clear();
+		record->counters.clear();
+		record->events.clear();
+	}
+}
+
+void profile_trace(bool on)
+{
+	tracing.store(on, std::memory_order_relaxed);
+}
+
+// Scope names are literals of the code, only quotes and backslashes need escaping
+static void write_json_string(std::FILE* file, const char* text)
+{
+	std::fputc('"', file);
+	for (const char* c = text; *c != '\0'; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			std::fputc('\\', file);
+		}
+		std::fputc(*c, file);
+	}
+	std::fputc('"', file);
+}
+
+bool profile_write_trace(const char* path)
+{
+	std::FILE* file = std::fopen(path, "wb");
+	if (file == nullptr)
+	{
+		return false;
+	}
+
+	std::fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+	bool first = true;
+	for (const std::shared_ptr <thread_record>& record : all_records())
+	{
+		std::lock_guard <std::mutex> lock(record->mutex);
+		for (const trace_event& e : record->events)
+		{
+			std::fputs(first ? "\n" : ",\n", file);
+			first = false;
+			std::fputs("{\"name\":", file);
+			write_json_string(file, e.name);
+			std::fprintf(file, ",\"cat\":\"bitmap\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"allocations\":%llu}}",
+				record->id, e.start / 1e3, e.duration / 1e3, static_cast<unsigned long long>(e.allocations));
+		}
+	}
+	std::fputs("\n]}\n", file);
+	return std::fclose(file) == 0;
+}
+
+bool profile_markers(bool on)
+{
+#ifdef __linux__
+	const int old = marker_file.exchange(-1);
+	if (old >= 0)
+	{
+		::close(old);
+	}
+	if (!on)
+	{
+		return true;
+	}
+	int fd = ::open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+	if (fd < 0)
+	{
+		fd = ::open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+	}
+	marker_file.store(fd);
+	return fd >= 0;
+#else
+	return !on;
+#endif
+}
+
+uint64_t profile_allocations()
+{
+	return allocation_count();
+}
+
+#else
+
+void profile_report(std::ostream& out)
+{
+	out << "Profiling is not compiled in, build with BITMAP_PROFILE=1" << "\n";
+}
+
+void profile_reset()
+{
+}
+
+void profile_trace(bool)
+{
+}
+
+bool profile_write_trace(const char*)
+{
+	return false;
+}
+
+bool profile_markers(bool on)
+{
+	return !on;
+}
+
+uint64_t profile_allocations()
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Scoped timers and counters for finding where a run spends its time. Built with
+// BITMAP_PROFILE=1 (the BITMAP_PROFILE CMake option), otherwise the macros expand to nothing
+// and the functions below do nothing, so instrumented code costs nothing in normal builds.
+//
+//	PROFILE_SCOPE("rescale"); // time and allocations until the end of the block
+//	PROFILE_COUNT("bytes read", size); // adds to a named counter
+//
+// Names must be string literals. Every thread keeps its own totals, the report sums them per
+// name and lists the share of every thread.
+
+#ifndef BITMAP_PROFILE
+#define BITMAP_PROFILE 0
+#endif
+
+// Totals of every scope and counter so far, per name and per thread
+void profile_report(std::ostream& out);
+void profile_reset();
+
+// Records every scope as a complete event while on, profile_write_trace saves them as a
+// Chrome trace (chrome://tracing, Perfetto)
+void profile_trace(bool on);
+bool profile_write_trace(const char* path);
+
+// Writes a begin and end marker of every scope to the kernel trace buffer (trace_marker) while
+// on, in the systrace format perf, trace-cmd and Perfetto show next to the samples
+bool profile_markers(bool on);
+
+// operator new calls so far, only counted in profiling builds
+uint64_t profile_allocations();
+
+#if BITMAP_PROFILE
+
+class profile_scope
+{
+public:
+	explicit profile_scope(const char* name);
+	profile_scope(const profile_scope&) = delete;
+	profile_scope& operator =(const profile_scope&) = delete;
+	~profile_scope();
+
+private:
+	const char* m_name;
+	int64_t m_start;
+	uint64_t m_allocations;
+};
+
+void profile_count(const char* name, uint64_t amount);
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) profile_scope PROFILE_JOIN(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(name, amount) profile_count(name, static_cast<uint64_t>(amount))
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(name, amount) ((void)0)
+
+#endif
@@ -0,0 +1,125 @@
+#include "pyramid.h"
+
+void box_downscale(const level_image& src, level_image& dst, int factor_x, int factor_y)
+{
+	const int width = dst.width();
+	const float scale = 1.0f / (factor_x * factor_y);
+
+	parallel_rows(dst.height(), [&](int first, int last)
+		{
+			std::vector <float> sums(width);
+			for (int c = 0; c < 3; c++)
+			{
+				for (int y = first; y < last; y++)
+				{
+					std::fill(sums.begin(), sums.end(), 0.0f);
+					for (int k = 0; k < factor_y; k++)
+					{
+						const float* in = src.row(y * factor_y + k, c);
+						for (int x = 0; x < width; x++)
+						{
+							float sum = 0.0f;
+							for (int i = 0; i < factor_x; i++)
+							{
+								sum += in[x * factor_x + i];
+							}
+							sums[x] += sum;
+						}
+					}
+					float* out = dst.row(y, c);
+					for (int x = 0; x < width; x++)
+					{
+						out[x] = sums[x] * scale;
+					}
+				}
+			}
+		});
+}
+
+// Pairwise sums of a row, the odd last sample added into the last pair
+static void pair_sums(const float* __restrict in, float* __restrict out, int src_width, int dst_width)
+{
+	for (int x = 0; x < dst_width; x++)
+	{
+		out[x] = in[2 * x] + in[2 * x + 1];
+	}
+	if (src_width & 1)
+	{
+		// three samples instead of two, rescaled so the weight matches
+		out[dst_width - 1] = (out[dst_width - 1] + in[src_width - 1]) * (2.0f / 3.0f);
+	}
+}
+
+void halve_level(const level_image& src, level_image& dst)
+{
+	const int src_width = src.width(), src_height = src.height();
+	const int width = dst.width(), height = dst.height();
+
+	parallel_rows(height, [&](int first, int last)
+		{
+			std::vector <float> top(width), bottom(width), extra(width);
+			for (int c = 0; c < 3; c++)
+			{
+				for (int y = first; y < last; y++)
+				{
+					pair_sums(src.row(2 * y, c), top.data(), src_width, width);
+					pair_sums(src.row(2 * y + 1, c), bottom.data(), src_width, width);
+					float* out = dst.row(y, c);
+					if (y == height - 1 && (src_height & 1))
+					{
+						pair_sums(src.row(src_height - 1, c), extra.data(), src_width, width);
+						for (int x = 0; x < width; x++)
+						{
+							out[x] = (top[x] + bottom[x] + extra[x]) * (0.5f / 3.0f);
+						}
+					}
+					else
+					{
+						for (int x = 0; x < width; x++)
+						{
+							out[x] = (top[x] + bottom[x]) * 0.25f;
+						}
+					}
+				}
+			}
+		});
+}
+
+void image_pyramid::build_levels(int min_size)
+{
+	for (;;)
+	{
+		const level_image& last = m_levels.back();
+		if (last.width() / 2 < min_size || last.height() / 2 < min_size)
+		{
+			return;
+		}
+		level_image next(last.width() / 2, last.height() / 2);
+		halve_level(m_levels.back(), next);
+		m_levels.push_back(std::move(next));
+	}
+}
+
+size_t image_pyramid::size_bytes() const
+{
+	size_t total = 0;
+	for (const level_image& level : m_levels)
+	{
+		total += level.size_bytes();
+	}
+	return total;
+}
+
+int image_pyramid::level_for(int width, int height) const
+{
+	int best = 0;
+	for (int i = 1; i < (int)m_levels.size(); i++)
+	{
+		if (m_levels[i].width() < width || m_levels[i].height() < height)
+		{
+			break;
+		}
+		best = i;
+	}
+	return best;
+}
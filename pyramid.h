@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include "image.h"
+#include "resample.h"
+#include "color.h"
+#include "thread_pool.h"
+
+using level_image = image<float, pixel_layout::planar>;
+
+// Averages factor_x x factor_y blocks, src must be exactly factor times the size of dst.
+// What the box kernel computes for an integer reduction, without the weight tables.
+void box_downscale(const level_image& src, level_image& dst, int factor_x, int factor_y);
+
+// Next pyramid level, each pixel the mean of a 2x2 block. With an odd size the last
+// column or row of dst also takes in the leftover one, so no source pixel is dropped.
+void halve_level(const level_image& src, level_image& dst);
+
+// Mip pyramid of one source: level 0 is the source as float planes, every further level
+// half the size of the previous one. Built once, each downscale then starts from a level
+// two to four times as large as the target, so a thumbnail costs a resample of a few
+// times its own size instead of one of the whole source.
+class image_pyramid
+{
+public:
+	template <typename T, pixel_layout L>
+	void build(const image<T, L>& src, int min_size = 16)
+	{
+		load(src);
+		build_levels(min_size);
+	}
+
+	// level 0 only, the source as float planes
+	template <typename T, pixel_layout L>
+	void load(const image<T, L>& src)
+	{
+		m_levels.clear();
+		m_levels.emplace_back(src.width(), src.height());
+		level_image& base = m_levels.back();
+		parallel_rows(src.height(), [&](int first, int last)
+			{
+				for (int y = first; y < last; y++)
+				{
+					for (int c = 0; c < 3; c++)
+					{
+						load_channel<T, image<T, L>::pixel_stride>(src.row(y, c), base.row(y, c), src.width(), nullptr);
+					}
+				}
+			});
+	}
+
+	int levels() const { return (int)m_levels.size(); }
+	const level_image& level(int i) const { return m_levels[i]; }
+	size_t size_bytes() const;
+
+	// smallest level with both sides at least width x height
+	int level_for(int width, int height) const;
+
+	// Downscales into dst using dst's size: the kernel resamples from the smallest level at
+	// least twice the size of dst on both sides, or from the source when none is. Approximate,
+	// the 2x2 means of the levels above it blur a little more than a direct resample_image.
+	// The box kernel averages the smallest level at least the size of dst instead, block means
+	// of block means are means of the larger blocks, and integer ratios skip the weight tables.
+	template <typename D, pixel_layout DL>
+	void resample(image<D, DL>& dst, resample_kernel kernel = resample_kernel::catmull_rom) const
+	{
+		if (kernel == resample_kernel::box)
+		{
+			const level_image& from = m_levels[level_for(dst.width(), dst.height())];
+			if (from.width() % dst.width() == 0 && from.height() % dst.height() == 0)
+			{
+				level_image box(dst.width(), dst.height());
+				box_downscale(from, box, from.width() / dst.width(), from.height() / dst.height());
+				convert_image(box, dst);
+				return;
+			}
+			resample_image(from, dst, kernel);
+			return;
+		}
+		resample_image(m_levels[level_for(2 * dst.width(), 2 * dst.height())], dst, kernel);
+	}
+
+private:
+	void build_levels(int min_size);
+
+	std::vector <level_image> m_levels;
+};
@@ -0,0 +1,238 @@
+#include "resample.h"
+#include <cmath>
+#include <algorithm>
+#include <list>
+#include <mutex>
+
+const double pi = 3.14159265358979323846;
+
+double kernel_radius(resample_kernel kernel)
+{
+	switch (kernel)
+	{
+	case resample_kernel::lanczos3:
+		return 3.0;
+	case resample_kernel::box:
+		return 0.5;
+	default:
+		return 2.0;
+	}
+}
+
+// Mitchell-Netravali family, (B, C) = (0, 0.5) is Catmull-Rom
+static double cubic_bc(double x, double B, double C)
+{
+	x = std::fabs(x);
+	if (x < 1.0)
+	{
+		return ((12 - 9 * B - 6 * C) * x * x * x + (-18 + 12 * B + 6 * C) * x * x + (6 - 2 * B)) / 6.0;
+	}
+	if (x < 2.0)
+	{
+		return ((-B - 6 * C) * x * x * x + (6 * B + 30 * C) * x * x + (-12 * B - 48 * C) * x + (8 * B + 24 * C)) / 6.0;
+	}
+	return 0.0;
+}
+
+static double sinc(double x)
+{
+	if (x == 0.0)
+	{
+		return 1.0;
+	}
+	x *= pi;
+	return std::sin(x) / x;
+}
+
+double kernel_value(resample_kernel kernel, double x)
+{
+	switch (kernel)
+	{
+	case resample_kernel::catmull_rom:
+		return cubic_bc(x, 0.0, 0.5);
+	case resample_kernel::mitchell:
+		return cubic_bc(x, 1.0 / 3.0, 1.0 / 3.0);
+	case resample_kernel::lanczos3:
+		return std::fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+	case resample_kernel::box:
+		return x >= -0.5 && x < 0.5 ? 1.0 : 0.0;
+	}
+	return 0.0;
+}
+
+void resample_weights::compute(int src_size, int dst_size, resample_kernel kernel)
+{
+	const double scale = (double)src_size / dst_size;
+	// when shrinking, stretch the kernel over the source so every input pixel contributes
+	const double stretch = std::max(scale, 1.0);
+	const double support = kernel_radius(kernel) * stretch;
+
+	taps = std::min((int)std::ceil(support * 2.0), src_size);
+	first.assign(dst_size, 0);
+	weights.assign(static_cast<size_t>(dst_size) * taps, 0.0f);
+
+	std::vector <double> scratch(taps);
+
+	for (int i = 0; i < dst_size; i++)
+	{
+		const double center = (i + 0.5) * scale - 0.5;
+		int start = (int)std::floor(center - support) + 1;
+		start = std::clamp(start, 0, src_size - taps);
+		first[i] = start;
+
+		double sum = 0.0;
+		for (int t = 0; t < taps; t++)
+		{
+			scratch[t] = kernel_value(kernel, (start + t - center) / stretch);
+			sum += scratch[t];
+		}
+
+		// near the edges the part of the kernel outside the image is dropped and the rest renormalized
+		for (int t = 0; t < taps; t++)
+		{
+			weights[static_cast<size_t>(i) * taps + t] = static_cast<float>(sum != 0.0 ? scratch[t] / sum : (t == 0 ? 1.0 : 0.0));
+		}
+	}
+}
+
+void resample_row(const float* __restrict in, float* __restrict out, const resample_weights& w, int dst_width)
+{
+	const int taps = w.taps;
+	for (int x = 0; x < dst_width; x++)
+	{
+		const float* __restrict weight = w.weights.data() + static_cast<size_t>(x) * taps;
+		const float* __restrict source = in + w.first[x];
+		float sum = 0.0f;
+		for (int t = 0; t < taps; t++)
+		{
+			sum += weight[t] * source[t];
+		}
+		out[x] = sum;
+	}
+}
+
+void resample_column(const float* __restrict plane, int plane_width, float* __restrict out, const resample_weights& w, int y)
+{
+	const int taps = w.taps;
+	const float* __restrict weight = w.weights.data() + static_cast<size_t>(y) * taps;
+	const float* __restrict source = plane + static_cast<size_t>(w.first[y]) * plane_width;
+
+	// row at a time so the inner loop runs over contiguous x
+	for (int x = 0; x < plane_width; x++)
+	{
+		out[x] = weight[0] * source[x];
+	}
+	for (int t = 1; t < taps; t++)
+	{
+		const float* __restrict row = source + static_cast<size_t>(t) * plane_width;
+		const float k = weight[t];
+		for (int x = 0; x < plane_width; x++)
+		{
+			out[x] += k * row[x];
+		}
+	}
+}
+
+void fixed_weights::quantize(const resample_weights& w)
+{
+	const int one = 1 << shift;
+	taps = w.taps;
+	first = w.first;
+	weights.resize(w.weights.size());
+
+	for (size_t i = 0; i < first.size(); i++)
+	{
+		const float* in = w.weights.data() + i * taps;
+		int16_t* out = weights.data() + i * taps;
+		int sum = 0, largest = 0;
+		for (int t = 0; t < taps; t++)
+		{
+			out[t] = static_cast<int16_t>(std::lround(in[t] * one));
+			sum += out[t];
+			largest = out[t] > out[largest] ? t : largest;
+		}
+		// rounding error goes to the largest tap so flat areas stay exactly flat
+		out[largest] = static_cast<int16_t>(out[largest] + one - sum);
+	}
+}
+
+void resample_row_fixed(const int16_t* __restrict in, int16_t* __restrict out, const fixed_weights& w, int dst_width)
+{
+	const int taps = w.taps;
+	// Q14 * 8 bit -> Q6, overshoot of the kernel stays well inside int16
+	const int drop = fixed_weights::shift - 6;
+	for (int x = 0; x < dst_width; x++)
+	{
+		const int16_t* __restrict weight = w.weights.data() + static_cast<size_t>(x) * taps;
+		const int16_t* __restrict source = in + w.first[x];
+		int32_t sum = 0;
+		for (int t = 0; t < taps; t++)
+		{
+			sum += weight[t] * source[t];
+		}
+		out[x] = static_cast<int16_t>((sum + (1 << (drop - 1))) >> drop);
+	}
+}
+
+void resample_column_fixed(const int16_t* __restrict plane, int plane_width, int32_t* __restrict scratch, uint8_t* __restrict out, int pixel_stride, const fixed_weights& w, int y)
+{
+	const int taps = w.taps;
+	const int16_t* __restrict weight = w.weights.data() + static_cast<size_t>(y) * taps;
+	const int16_t* __restrict source = plane + static_cast<size_t>(w.first[y]) * plane_width;
+	const int drop = fixed_weights::shift + 6;
+
+	for (int x = 0; x < plane_width; x++)
+	{
+		scratch[x] = 1 << (drop - 1);
+	}
+	for (int t = 0; t < taps; t++)
+	{
+		const int16_t* __restrict row = source + static_cast<size_t>(t) * plane_width;
+		const int32_t k = weight[t];
+		for (int x = 0; x < plane_width; x++)
+		{
+			scratch[x] += k * row[x];
+		}
+	}
+	for (int x = 0; x < plane_width; x++)
+	{
+		const int32_t v = scratch[x] >> drop;
+		out[x * pixel_stride] = static_cast<uint8_t>(v < 0 ? 0 : (v > 255 ? 255 : v));
+	}
+}
+
+std::shared_ptr <const resample_weights> cached_weights(int src_size, int dst_size, resample_kernel kernel)
+{
+	struct entry
+	{
+		int src_size, dst_size;
+		resample_kernel kernel;
+		std::shared_ptr <const resample_weights> weights;
+	};
+	static std::mutex mutex;
+	static std::list <entry> entries; // most recently used first
+	const size_t capacity = 64;
+
+	{
+		std::lock_guard <std::mutex> lock(mutex);
+		for (auto it = entries.begin(); it != entries.end(); ++it)
+		{
+			if (it->src_size == src_size && it->dst_size == dst_size && it->kernel == kernel)
+			{
+				entries.splice(entries.begin(), entries, it);
+				return it->weights;
+			}
+		}
+	}
+
+	std::shared_ptr <resample_weights> weights = std::make_shared<resample_weights>();
+	weights->compute(src_size, dst_size, kernel);
+
+	std::lock_guard <std::mutex> lock(mutex);
+	entries.push_front({ src_size, dst_size, kernel, weights });
+	if (entries.size() > capacity)
+	{
+		entries.pop_back();
+	}
+	return weights;
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include "image.h"
+#include "thread_pool.h"
+#include "color.h"
+
+// Reconstruction filters for resampling
+enum class resample_kernel
+{
+	catmull_rom, // bicubic, a = -0.5
+	mitchell, // B = C = 1/3
+	lanczos3,
+	box // area average, exact for integer reductions
+};
+
+double kernel_radius(resample_kernel kernel);
+double kernel_value(resample_kernel kernel, double x);
+
+// Filter taps of one axis, computed once per scale factor.
+// Output sample i is the sum of weights[i * taps + t] * input[first[i] + t].
+struct resample_weights
+{
+	int taps = 0;
+	std::vector <int> first;
+	std::vector <float> weights;
+
+	void compute(int src_size, int dst_size, resample_kernel kernel);
+};
+
+// Q14 copy of a set of weights for the 8 bit path, every output's taps sum to exactly 1 << 14
+struct fixed_weights
+{
+	static const int shift = 14;
+	int taps = 0;
+	std::vector <int> first;
+	std::vector <int16_t> weights;
+
+	void quantize(const resample_weights& w);
+};
+
+// Horizontal pass of a row of samples widened to int16 into a row of Q6 intermediates
+void resample_row_fixed(const int16_t* in, int16_t* out, const fixed_weights& w, int dst_width);
+
+// Vertical pass from the Q6 plane into bytes, rounded and saturated
+void resample_column_fixed(const int16_t* plane, int plane_width, int32_t* scratch, uint8_t* out, int pixel_stride, const fixed_weights& w, int y);
+
+// Weights for a size pair out of a small least recently used table shared by all threads,
+// repeated rescales between the same sizes skip the kernel evaluation
+std::shared_ptr <const resample_weights> cached_weights(int src_size, int dst_size, resample_kernel kernel);
+
+// Horizontal pass of one source row (already float, contiguous) into a row of the intermediate plane
+void resample_row(const float* in, float* out, const resample_weights& w, int dst_width);
+
+// Vertical pass producing output row y from the intermediate plane
+void resample_column(const float* plane, int plane_width, float* out, const resample_weights& w, int y);
+
+// Resamples src into dst using dst's size, two separable 1-D passes per channel. Apart from
+// the intermediate plane it allocates nothing, the row buffers are the threads' scratch.
+// With linear_light the filter runs on linear light values instead of sRGB encoded ones,
+// which keeps high contrast edges from darkening on downscale.
+template <typename S, pixel_layout SL, typename D, pixel_layout DL>
+void resample_image(const image<S, SL>& src, image<D, DL>& dst, resample_kernel kernel, bool linear_light = false)
+{
+	const int src_width = src.width(), src_height = src.height();
+	const int dst_width = dst.width(), dst_height = dst.height();
+
+	const std::shared_ptr <const resample_weights> horizontal_weights = cached_weights(src_width, dst_width, kernel);
+	const std::shared_ptr <const resample_weights> vertical_weights = cached_weights(src_height, dst_height, kernel);
+	const resample_weights& horizontal = *horizontal_weights;
+	const resample_weights& vertical = *vertical_weights;
+
+	std::vector <float> plane(static_cast<size_t>(dst_width) * src_height);
+
+	for (int c = 0; c < 3; c++)
+	{
+		parallel_rows(src_height, [&](int first, int last)
+			{
+				float* in_row = thread_scratch(src_width);
+				for (int y = first; y < last; y++)
+				{
+					// bytes decode straight through the table, wider samples through the interpolated one
+					load_channel<S, image<S, SL>::pixel_stride>(src.row(y, c), in_row, src_width, linear_light ? srgb8_linear_table() : nullptr);
+					if (linear_light && !std::is_same<S, uint8_t>::value)
+					{
+						srgb_to_linear_fast_row(in_row, src_width);
+					}
+					resample_row(in_row, plane.data() + static_cast<size_t>(y) * dst_width, horizontal, dst_width);
+				}
+			});
+
+		parallel_rows(dst_height, [&](int first, int last)
+			{
+				float* out_row = thread_scratch(dst_width);
+				for (int y = first; y < last; y++)
+				{
+					resample_column(plane.data(), dst_width, out_row, vertical, y);
+					if (linear_light)
+					{
+						linear_to_srgb_fast_row(out_row, dst_width);
+					}
+					store_channel<D, image<D, DL>::pixel_stride>(out_row, dst.row(y, c), dst_width);
+				}
+			});
+	}
+}
+
+// Integer only resampling between 8 bit images: Q14 weights, int16 intermediates with 6
+// fractional bits and int32 sums, rounded to nearest and saturated at both ends. Within
+// one step of resample_image on the same input.
+template <pixel_layout SL, pixel_layout DL>
+void resample_image_fixed(const image<uint8_t, SL>& src, image<uint8_t, DL>& dst, resample_kernel kernel)
+{
+	const int src_width = src.width(), src_height = src.height();
+	const int dst_width = dst.width(), dst_height = dst.height();
+
+	fixed_weights horizontal, vertical;
+	horizontal.quantize(*cached_weights(src_width, dst_width, kernel));
+	vertical.quantize(*cached_weights(src_height, dst_height, kernel));
+
+	std::vector <int16_t> plane(static_cast<size_t>(dst_width) * src_height);
+
+	for (int c = 0; c < 3; c++)
+	{
+		parallel_rows(src_height, [&](int first, int last)
+			{
+				std::vector <int16_t> in_row(src_width);
+				for (int y = first; y < last; y++)
+				{
+					const uint8_t* in = src.row(y, c);
+					for (int x = 0; x < src_width; x++)
+					{
+						in_row[x] = in[x * image<uint8_t, SL>::pixel_stride];
+					}
+					resample_row_fixed(in_row.data(), plane.data() + static_cast<size_t>(y) * dst_width, horizontal, dst_width);
+				}
+			});
+
+		parallel_rows(dst_height, [&](int first, int last)
+			{
+				std::vector <int32_t> scratch(dst_width);
+				for (int y = first; y < last; y++)
+				{
+					resample_column_fixed(plane.data(), dst_width, scratch.data(), dst.row(y, c), image<uint8_t, DL>::pixel_stride, vertical, y);
+				}
+			});
+	}
+}
@@ -0,0 +1,62 @@
+#include "resample.h"
+#include "allocation_counter.h"
+#include "thread_pool.h"
+#include <iostream>
+#include <vector>
+
+using rgb8_image = image<uint8_t, pixel_layout::interleaved>;
+
+// Allocations of one resample of source into dst, the output itself made beforehand
+static uint64_t resample_allocations(const rgb8_image& source, rgb8_image& dst)
+{
+	const uint64_t before = allocation_count();
+	resample_image(source, dst, resample_kernel::catmull_rom);
+	return allocation_count() - before;
+}
+
+// The resampler allocates its intermediate plane and a few fixed things around it, none of it
+// per output pixel or per row: after the first call of a size has computed its weights, the
+// count must be the same for every output size.
+int main()
+{
+	rgb8_image source(640, 480);
+	for (int y = 0; y < source.height(); y++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			uint8_t* row = source.row(y, c);
+			for (int x = 0; x < source.width(); x++)
+			{
+				row[x * rgb8_image::pixel_stride] = (uint8_t)((x * 7 + y * 13 + c * 5) & 255);
+			}
+		}
+	}
+
+	const int sizes[][2] = { { 32, 24 }, { 160, 120 }, { 640, 480 }, { 1280, 960 }, { 2560, 1920 } };
+	std::vector <rgb8_image> outputs;
+	for (const auto& size : sizes)
+	{
+		outputs.emplace_back(size[0], size[1]);
+	}
+
+	// one thread, so the scratch rows every thread keeps are grown by the same first calls each run
+	thread_pool::set_thread_count(1);
+	for (rgb8_image& dst : outputs)
+	{
+		resample_allocations(source, dst);
+	}
+
+	bool failed = false;
+	const uint64_t expected = resample_allocations(source, outputs[0]);
+	for (rgb8_image& dst : outputs)
+	{
+		const uint64_t count = resample_allocations(source, dst);
+		std::cout << dst.width() << "x" << dst.height() << ": " << count << " allocations" << "\n";
+		if (count != expected)
+		{
+			std::cout << "expected " << expected << ", as for " << outputs[0].width() << "x" << outputs[0].height() << "\n";
+			failed = true;
+		}
+	}
+	return failed ? 1 : 0;
+}
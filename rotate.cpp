@@ -0,0 +1,51 @@
+#include "rotate.h"
+
+rotation_frame rotation_bounds(int width, int height, double degree)
+{
+	rotation_frame frame;
+
+	const int turns = right_angle_turns(degree);
+	if (turns >= 0)
+	{
+		// exact, so the corner sums below do not truncate to one pixel short
+		const int sines[4] = { 0, 1, 0, -1 };
+		frame.sinx = sines[turns];
+		frame.cosx = sines[(turns + 1) % 4];
+	}
+	else
+	{
+		degree *= 0.0174532925;
+		frame.sinx = sin(degree);
+		frame.cosx = cos(degree);
+	}
+
+	// corners of the source after rotation, the fourth one is (0, 0)
+	int x1 = -height * frame.sinx;
+	int x2 = width * frame.cosx - height * frame.sinx;
+	int x3 = width * frame.cosx;
+	int y1 = height * frame.cosx;
+	int y2 = height * frame.cosx + width * frame.sinx;
+	int y3 = width * frame.sinx;
+
+	frame.minx = std::min(0, std::min(x1, std::min(x2, x3)));
+	frame.miny = std::min(0, std::min(y1, std::min(y2, y3)));
+	int maxx = std::max(0, std::max(x1, std::max(x2, x3)));
+	int maxy = std::max(0, std::max(y1, std::max(y2, y3)));
+
+	// tiny sources can truncate to nothing, keep at least one pixel
+	frame.width = std::max(1, maxx - frame.minx);
+	frame.height = std::max(1, maxy - frame.miny);
+
+	return frame;
+}
+
+int right_angle_turns(double degree)
+{
+	double turns = degree / 90.0;
+	if (turns != std::floor(turns))
+	{
+		return -1;
+	}
+	int t = (int)std::fmod(turns, 4.0);
+	return t < 0 ? t + 4 : t;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include "image.h"
+#include "thread_pool.h"
+#include "transpose.h"
+
+enum class rotate_filter
+{
+	nearest,
+	bilinear,
+	bicubic
+};
+
+// Output size of a rotation and where its corner lands in source space
+struct rotation_frame
+{
+	int width, height;
+	int minx, miny;
+	double sinx, cosx;
+};
+
+rotation_frame rotation_bounds(int width, int height, double degree);
+
+// 0 - 3 quarter turns counterclockwise when degree is a multiple of 90, otherwise -1
+int right_angle_turns(double degree);
+
+// Rotation by a multiple of 90 degrees. Quarter turns are transposes of a source walked
+// with one reversed axis, half turns copy every row backwards.
+template <typename T, pixel_layout L>
+void rotate_right_angle(const image<T, L>& src, image<T, L>& dst, int turns)
+{
+	const int width = src.width(), height = src.height();
+	const int N = L == pixel_layout::interleaved ? 3 : 1;
+	const int planes = 3 / N;
+
+	if (turns % 2 == 0)
+	{
+		dst.resize(width, height);
+	}
+	else
+	{
+		dst.resize(height, width);
+	}
+
+	// sample distance between neighbouring rows and columns
+	const ptrdiff_t src_row = (ptrdiff_t)width * N, dst_row = (ptrdiff_t)dst.width() * N;
+
+	parallel_tiles(dst.width(), dst.height(), [&](const tile& t)
+		{
+			for (int c = 0; c < planes; c++)
+			{
+				const T* base = src.row(0, c);
+				T* out = dst.row(0, c);
+
+				if (turns == 2)
+				{
+					for (int y = t.y0; y < t.y1; y++)
+					{
+						const T* in = base + (height - 1 - y) * src_row;
+						for (int x = t.x0; x < t.x1; x++)
+						{
+							for (int k = 0; k < N; k++)
+							{
+								out[y * dst_row + x * N + k] = in[(width - 1 - x) * N + k];
+							}
+						}
+					}
+				}
+				else if (turns == 1)
+				{
+					// dst(x, y) = src(y, height - 1 - x)
+					const T* first = base + (height - 1 - t.x0) * src_row + (ptrdiff_t)t.y0 * N;
+					transpose_block<T, N>(first, N, -src_row, out + t.y0 * dst_row + (ptrdiff_t)t.x0 * N, N, dst_row, t.y1 - t.y0, t.x1 - t.x0);
+				}
+				else
+				{
+					// dst(x, y) = src(width - 1 - y, x)
+					const T* first = base + (ptrdiff_t)t.x0 * src_row + (ptrdiff_t)(width - 1 - t.y0) * N;
+					transpose_block<T, N>(first, -N, src_row, out + t.y0 * dst_row + (ptrdiff_t)t.x0 * N, N, dst_row, t.y1 - t.y0, t.x1 - t.x0);
+				}
+			}
+		});
+}
@@ -0,0 +1,708 @@
+#include "stream.h"
+#include "color.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+static int seek_to(std::FILE* f, long long offset)
+{
+#ifdef _WIN32
+	return _fseeki64(f, offset, SEEK_SET);
+#else
+	return fseeko(f, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// first `rows` rows of band as a band of their own
+static void copy_rows(const band_image& band, int rows, band_image& out)
+{
+	out.resize(band.width(), rows);
+	for (int c = 0; c < 3; c++)
+	{
+		for (int y = 0; y < rows; y++)
+		{
+			std::copy(band.row(y, c), band.row(y, c) + band.width(), out.row(y, c));
+		}
+	}
+}
+
+bool grayscale_stage::begin(int width, int height)
+{
+	return m_next.begin(width, height);
+}
+
+void grayscale_stage::push(const band_image& band, int first_row)
+{
+	if (m_band.width() != band.width() || m_band.height() != band.height())
+	{
+		m_band.resize(band.width(), band.height());
+	}
+
+	for (int y = 0; y < band.height(); y++)
+	{
+		luma_row(band.row(y, 0), band.row(y, 1), band.row(y, 2), m_band.row(y, 0), band.width(), luma_standard::bt601);
+		std::copy(m_band.row(y, 0), m_band.row(y, 0) + band.width(), m_band.row(y, 1));
+		std::copy(m_band.row(y, 0), m_band.row(y, 0) + band.width(), m_band.row(y, 2));
+	}
+
+	m_next.push(m_band, first_row);
+}
+
+bool grayscale_stage::finish()
+{
+	return m_next.finish();
+}
+
+rescale_stage::rescale_stage(band_sink& next, int new_width, int new_height, resample_kernel kernel, int band_height) : band_stage(next)
+{
+	m_new_width = new_width;
+	m_new_height = new_height;
+	m_band_height = band_height;
+	m_kernel = kernel;
+	m_rows_first = 0;
+	m_rows_count = 0;
+	m_next_row = 0;
+	m_band_first = 0;
+	m_band_rows = 0;
+}
+
+bool rescale_stage::begin(int width, int height)
+{
+	m_horizontal.compute(width, m_new_width, m_kernel);
+	m_vertical.compute(height, m_new_height, m_kernel);
+	m_rows.assign(static_cast<size_t>(m_vertical.taps) * 3 * m_new_width, 0.0f);
+	m_rows_first = 0;
+	m_rows_count = 0;
+	m_next_row = 0;
+	m_band_first = 0;
+	m_band_rows = 0;
+	m_band.resize(m_new_width, std::min(m_band_height, m_new_height));
+	return m_next.begin(m_new_width, m_new_height);
+}
+
+void rescale_stage::push(const band_image& band, int first_row)
+{
+	for (int y = 0; y < band.height(); y++)
+	{
+		if (m_rows_count == 0)
+		{
+			m_rows_first = first_row + y;
+		}
+		float* row = held_row(first_row + y);
+		for (int c = 0; c < 3; c++)
+		{
+			resample_row(band.row(y, c), row + static_cast<size_t>(c) * m_new_width, m_horizontal, m_new_width);
+		}
+		m_rows_count++;
+		emit_ready_rows();
+	}
+}
+
+float* rescale_stage::held_row(int source_row)
+{
+	return m_rows.data() + static_cast<size_t>(source_row % m_vertical.taps) * 3 * m_new_width;
+}
+
+void rescale_stage::emit_ready_rows()
+{
+	const int taps = m_vertical.taps;
+
+	while (m_next_row < m_new_height)
+	{
+		const int first = m_vertical.first[m_next_row];
+		if (first + taps > m_rows_first + m_rows_count)
+		{
+			return;
+		}
+
+		const float* weight = m_vertical.weights.data() + static_cast<size_t>(m_next_row) * taps;
+		for (int c = 0; c < 3; c++)
+		{
+			float* out = m_band.row(m_band_rows, c);
+			std::fill(out, out + m_new_width, 0.0f);
+			for (int t = 0; t < taps; t++)
+			{
+				const float* in = held_row(first + t) + static_cast<size_t>(c) * m_new_width;
+				const float k = weight[t];
+				for (int x = 0; x < m_new_width; x++)
+				{
+					out[x] += k * in[x];
+				}
+			}
+		}
+
+		m_next_row++;
+		if (++m_band_rows == m_band.height())
+		{
+			flush_band();
+		}
+
+		// rows above the next window are never needed again
+		const int keep = m_next_row < m_new_height ? m_vertical.first[m_next_row] : m_rows_first + m_rows_count;
+		while (m_rows_count > 0 && m_rows_first < keep)
+		{
+			m_rows_first++;
+			m_rows_count--;
+		}
+	}
+}
+
+void rescale_stage::flush_band()
+{
+	if (m_band_rows == 0)
+	{
+		return;
+	}
+	if (m_band_rows == m_band.height())
+	{
+		m_next.push(m_band, m_band_first);
+	}
+	else
+	{
+		band_image partial;
+		copy_rows(m_band, m_band_rows, partial);
+		m_next.push(partial, m_band_first);
+	}
+	m_band_first += m_band_rows;
+	m_band_rows = 0;
+}
+
+bool rescale_stage::finish()
+{
+	flush_band();
+	m_rows_count = 0;
+	return m_next_row == m_new_height && m_next.finish();
+}
+
+rotate90_stage::rotate90_stage(band_sink& next, int turns, int band_height) : band_stage(next)
+{
+	m_turns = ((turns % 4) + 4) % 4;
+	m_band_height = band_height;
+	m_width = 0;
+	m_height = 0;
+	m_spill = nullptr;
+	m_failed = false;
+}
+
+rotate90_stage::~rotate90_stage()
+{
+	if (m_spill != nullptr)
+	{
+		std::fclose(m_spill);
+	}
+}
+
+bool rotate90_stage::begin(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_failed = false;
+
+	if (m_turns == 0)
+	{
+		return m_next.begin(width, height);
+	}
+
+	m_spill = std::tmpfile();
+	if (m_spill == nullptr)
+	{
+		std::cout << "File open not" << "\n";
+		return false;
+	}
+
+	if (m_turns == 2)
+	{
+		return m_next.begin(width, height);
+	}
+	return m_next.begin(height, width);
+}
+
+bool rotate90_stage::write_at(long long pixel, const float* rgb, int count)
+{
+	if (seek_to(m_spill, pixel * 3 * (long long)sizeof(float)) != 0 ||
+		std::fwrite(rgb, sizeof(float) * 3, count, m_spill) != (size_t)count)
+	{
+		m_failed = true;
+		return false;
+	}
+	return true;
+}
+
+void rotate90_stage::push(const band_image& band, int first_row)
+{
+	if (m_turns == 0)
+	{
+		m_next.push(band, first_row);
+		return;
+	}
+	if (m_failed)
+	{
+		return;
+	}
+
+	const int rows = band.height();
+	const int last_row = first_row + rows;
+
+	if (m_turns == 2)
+	{
+		// source row y becomes output row height - 1 - y, read backwards
+		m_segment.resize(static_cast<size_t>(m_width) * 3);
+		for (int y = 0; y < rows; y++)
+		{
+			for (int x = 0; x < m_width; x++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					m_segment[x * 3 + c] = band.row(y, c)[m_width - 1 - x];
+				}
+			}
+			write_at((long long)(m_height - 1 - (first_row + y)) * m_width, m_segment.data(), m_width);
+		}
+		return;
+	}
+
+	// every source column of the band is a run of `rows` pixels in one output row
+	m_segment.resize(static_cast<size_t>(rows) * 3);
+	for (int sx = 0; sx < m_width; sx++)
+	{
+		long long start;
+		if (m_turns == 1)
+		{
+			// output (x, y) = source (y, height - 1 - x)
+			for (int k = 0; k < rows; k++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					m_segment[k * 3 + c] = band.row(rows - 1 - k, c)[sx];
+				}
+			}
+			start = (long long)sx * m_height + (m_height - last_row);
+		}
+		else
+		{
+			// output (x, y) = source (width - 1 - y, x)
+			for (int k = 0; k < rows; k++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					m_segment[k * 3 + c] = band.row(k, c)[sx];
+				}
+			}
+			start = (long long)(m_width - 1 - sx) * m_height + first_row;
+		}
+		if (!write_at(start, m_segment.data(), rows))
+		{
+			return;
+		}
+	}
+}
+
+bool rotate90_stage::finish()
+{
+	if (m_turns == 0)
+	{
+		return m_next.finish();
+	}
+	if (m_failed || seek_to(m_spill, 0) != 0)
+	{
+		std::cout << "File write not" << "\n";
+		return false;
+	}
+
+	const int out_width = m_turns == 2 ? m_width : m_height;
+	const int out_height = m_turns == 2 ? m_height : m_width;
+
+	band_image band;
+	std::vector <float> row(static_cast<size_t>(out_width) * 3);
+	for (int first = 0; first < out_height; first += m_band_height)
+	{
+		const int rows = std::min(m_band_height, out_height - first);
+		if (band.height() != rows)
+		{
+			band.resize(out_width, rows);
+		}
+		for (int y = 0; y < rows; y++)
+		{
+			if (std::fread(row.data(), sizeof(float) * 3, out_width, m_spill) != (size_t)out_width)
+			{
+				std::cout << "File read not" << "\n";
+				return false;
+			}
+			for (int c = 0; c < 3; c++)
+			{
+				float* out = band.row(y, c);
+				for (int x = 0; x < out_width; x++)
+				{
+					out[x] = row[x * 3 + c];
+				}
+			}
+		}
+		m_next.push(band, first);
+	}
+
+	std::fclose(m_spill);
+	m_spill = nullptr;
+	return m_next.finish();
+}
+
+split_stage::split_stage(band_sink& red, band_sink& green, band_sink& blue)
+{
+	m_sinks[0] = &red;
+	m_sinks[1] = &green;
+	m_sinks[2] = &blue;
+}
+
+bool split_stage::begin(int width, int height)
+{
+	bool ok = true;
+	for (band_sink* sink : m_sinks)
+	{
+		ok = sink->begin(width, height) && ok;
+	}
+	return ok;
+}
+
+void split_stage::push(const band_image& band, int first_row)
+{
+	if (m_band.width() != band.width() || m_band.height() != band.height())
+	{
+		m_band.resize(band.width(), band.height());
+	}
+
+	for (int keep = 0; keep < 3; keep++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			for (int y = 0; y < band.height(); y++)
+			{
+				if (c == keep)
+				{
+					std::copy(band.row(y, c), band.row(y, c) + band.width(), m_band.row(y, c));
+				}
+				else
+				{
+					std::fill(m_band.row(y, c), m_band.row(y, c) + band.width(), 0.0f);
+				}
+			}
+		}
+		m_sinks[keep]->push(m_band, first_row);
+	}
+}
+
+bool split_stage::finish()
+{
+	bool ok = true;
+	for (band_sink* sink : m_sinks)
+	{
+		ok = sink->finish() && ok;
+	}
+	return ok;
+}
+
+tee_stage::tee_stage(const std::vector <band_sink*>& sinks)
+{
+	m_sinks = sinks;
+}
+
+bool tee_stage::begin(int width, int height)
+{
+	bool ok = true;
+	for (band_sink* sink : m_sinks)
+	{
+		ok = sink->begin(width, height) && ok;
+	}
+	return ok;
+}
+
+void tee_stage::push(const band_image& band, int first_row)
+{
+	for (band_sink* sink : m_sinks)
+	{
+		sink->push(band, first_row);
+	}
+}
+
+bool tee_stage::finish()
+{
+	bool ok = true;
+	for (band_sink* sink : m_sinks)
+	{
+		ok = sink->finish() && ok;
+	}
+	return ok;
+}
+
+difference_stage::difference_stage(band_sink& next, const band_image& reference) : band_stage(next), m_reference(reference)
+{
+}
+
+bool difference_stage::begin(int width, int height)
+{
+	if (width != m_reference.width() || height != m_reference.height())
+	{
+		std::cout << "Sizes match not" << "\n";
+		return false;
+	}
+	return m_next.begin(width, height);
+}
+
+void difference_stage::push(const band_image& band, int first_row)
+{
+	if (m_band.width() != band.width() || m_band.height() != band.height())
+	{
+		m_band.resize(band.width(), band.height());
+	}
+
+	for (int c = 0; c < 3; c++)
+	{
+		for (int y = 0; y < band.height(); y++)
+		{
+			const float* in = band.row(y, c);
+			const float* reference = m_reference.row(first_row + y, c);
+			float* out = m_band.row(y, c);
+			for (int x = 0; x < band.width(); x++)
+			{
+				out[x] = std::fabs(in[x] - reference[x]);
+			}
+		}
+	}
+
+	m_next.push(m_band, first_row);
+}
+
+bool difference_stage::finish()
+{
+	return m_next.finish();
+}
+
+async_sink::async_sink(band_sink& target, int depth) : m_target(target)
+{
+	m_depth = depth;
+	m_closing = false;
+}
+
+async_sink::~async_sink()
+{
+	stop();
+}
+
+bool async_sink::begin(int width, int height)
+{
+	stop();
+	if (!m_target.begin(width, height))
+	{
+		return false;
+	}
+	m_closing = false;
+	m_thread = std::thread(&async_sink::worker, this);
+	return true;
+}
+
+void async_sink::push(const band_image& band, int first_row)
+{
+	band_image copy;
+	{
+		std::unique_lock <std::mutex> lock(m_mutex);
+		m_changed.wait(lock, [this] { return (int)m_queue.size() < m_depth; });
+		if (!m_free.empty())
+		{
+			copy = std::move(m_free.back());
+			m_free.pop_back();
+		}
+	}
+
+	copy = band;
+
+	{
+		std::lock_guard <std::mutex> lock(m_mutex);
+		m_queue.emplace_back(std::move(copy), first_row);
+	}
+	m_changed.notify_all();
+}
+
+void async_sink::worker()
+{
+	for (;;)
+	{
+		std::pair <band_image, int> item;
+		{
+			std::unique_lock <std::mutex> lock(m_mutex);
+			m_changed.wait(lock, [this] { return !m_queue.empty() || m_closing; });
+			if (m_queue.empty())
+			{
+				return;
+			}
+			item = std::move(m_queue.front());
+			m_queue.pop_front();
+		}
+		m_changed.notify_all();
+
+		m_target.push(item.first, item.second);
+
+		{
+			std::lock_guard <std::mutex> lock(m_mutex);
+			m_free.push_back(std::move(item.first));
+		}
+	}
+}
+
+void async_sink::stop()
+{
+	if (!m_thread.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard <std::mutex> lock(m_mutex);
+		m_closing = true;
+	}
+	m_changed.notify_all();
+	m_thread.join();
+}
+
+bool async_sink::finish()
+{
+	// the worker drains the queue before it leaves
+	stop();
+	return m_target.finish();
+}
+
+bmp_band_writer::bmp_band_writer(const char* path, size_t buffer_size)
+{
+	m_path = path;
+	m_buffer_size = buffer_size;
+}
+
+bool bmp_band_writer::begin(int width, int height)
+{
+	if (!m_writer.open(m_path, width, height, m_buffer_size))
+	{
+		std::cout << "File open not" << "\n";
+		return false;
+	}
+	return true;
+}
+
+void bmp_band_writer::push(const band_image& band, int)
+{
+	for (int y = 0; y < band.height(); y++)
+	{
+		encode_bmp_row(band, y, m_writer.next_row());
+		m_writer.push_row();
+	}
+}
+
+bool bmp_band_writer::finish()
+{
+	return m_writer.close();
+}
+
+text_dump_sink::text_dump_sink(const char* path)
+{
+	m_path = path;
+	m_file = nullptr;
+}
+
+text_dump_sink::~text_dump_sink()
+{
+	if (m_file != nullptr)
+	{
+		std::fclose(m_file);
+	}
+}
+
+bool text_dump_sink::begin(int, int)
+{
+	m_file = std::fopen(m_path, "w");
+	if (m_file == nullptr)
+	{
+		std::cout << "File open not" << "\n";
+		return false;
+	}
+	m_buffer.resize(1 << 20);
+	std::setvbuf(m_file, m_buffer.data(), _IOFBF, m_buffer.size());
+	return true;
+}
+
+void text_dump_sink::push(const band_image& band, int)
+{
+	for (int y = 0; y < band.height(); y++)
+	{
+		for (int x = 0; x < band.width(); x++)
+		{
+			std::fprintf(m_file, "%d %d %d\n", (int)to_sample<uint8_t>(band.row(y, 0)[x]), (int)to_sample<uint8_t>(band.row(y, 1)[x]), (int)to_sample<uint8_t>(band.row(y, 2)[x]));
+		}
+	}
+}
+
+bool text_dump_sink::finish()
+{
+	const bool ok = std::fclose(m_file) == 0;
+	m_file = nullptr;
+	return ok;
+}
+
+bool stream_bmp(const char* path, band_sink& sink, int band_height)
+{
+	bmp_view view;
+	if (!view.open(path))
+	{
+		return false;
+	}
+
+	const int width = view.width(), height = view.height();
+	if (!sink.begin(width, height))
+	{
+		return false;
+	}
+
+	band_image band;
+	for (int first = 0; first < height; first += band_height)
+	{
+		const int rows = std::min(band_height, height - first);
+		if (band.height() != rows)
+		{
+			band.resize(width, rows);
+		}
+		for (int y = 0; y < rows; y++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				convert_bgr_channel<float, 1>(view.row(first + y), band.row(y, c), width, c);
+			}
+		}
+		view.release_rows(first, first + rows);
+		sink.push(band, first);
+	}
+
+	return sink.finish();
+}
+
+bool stream_image(const band_image& image, band_sink& sink, int band_height)
+{
+	const int width = image.width(), height = image.height();
+	if (!sink.begin(width, height))
+	{
+		return false;
+	}
+
+	band_image band;
+	for (int first = 0; first < height; first += band_height)
+	{
+		const int rows = std::min(band_height, height - first);
+		if (band.height() != rows)
+		{
+			band.resize(width, rows);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			for (int y = 0; y < rows; y++)
+			{
+				std::copy(image.row(first + y, c), image.row(first + y, c) + width, band.row(y, c));
+			}
+		}
+		sink.push(band, first);
+	}
+
+	return sink.finish();
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "image.h"
+#include "resample.h"
+#include "bmp_file.h"
+
+// Streaming mode for images that do not fit in memory. Rows travel through a chain of
+// stages in bands of a few dozen rows, from the source file to the destination file,
+// so peak memory depends on the band height and the filter size, not on the image.
+
+using band_image = image<float, pixel_layout::planar>;
+
+class band_sink
+{
+public:
+	virtual ~band_sink() {}
+	virtual bool begin(int width, int height) = 0;
+	// rows [first_row, first_row + band.height()), bands arrive in row order
+	virtual void push(const band_image& band, int first_row) = 0;
+	virtual bool finish() = 0;
+};
+
+// A stage that hands its output on to the next sink
+class band_stage : public band_sink
+{
+public:
+	explicit band_stage(band_sink& next) : m_next(next) {}
+
+protected:
+	band_sink& m_next;
+};
+
+class grayscale_stage : public band_stage
+{
+public:
+	explicit grayscale_stage(band_sink& next) : band_stage(next) {}
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	band_image m_band;
+};
+
+// Separable resampling, keeps only the horizontally filtered rows the vertical filter still needs
+class rescale_stage : public band_stage
+{
+public:
+	rescale_stage(band_sink& next, int new_width, int new_height, resample_kernel kernel = resample_kernel::catmull_rom, int band_height = 64);
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	void emit_ready_rows();
+	void flush_band();
+	float* held_row(int source_row);
+
+	int m_new_width, m_new_height, m_band_height;
+	resample_kernel m_kernel;
+	resample_weights m_horizontal, m_vertical;
+	// horizontally resampled rows of the vertical window, source rows m_rows_first on, 3 planes
+	// per row. A ring of one row per vertical tap, the window never holds more.
+	std::vector <float> m_rows;
+	int m_rows_first;
+	int m_rows_count;
+	int m_next_row;
+	band_image m_band;
+	int m_band_first;
+	int m_band_rows;
+};
+
+// Quarter, half or three quarter turn. The transposed rows are parked in a temporary
+// file and streamed on once the last input band has arrived.
+class rotate90_stage : public band_stage
+{
+public:
+	rotate90_stage(band_sink& next, int turns, int band_height = 64);
+	~rotate90_stage() override;
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	bool write_at(long long pixel, const float* rgb, int count);
+
+	int m_turns, m_band_height;
+	int m_width, m_height; // input size
+	std::FILE* m_spill;
+	std::vector <float> m_segment;
+	bool m_failed;
+};
+
+// Sends each channel to its own sink with the other two channels set to zero
+class split_stage : public band_sink
+{
+public:
+	split_stage(band_sink& red, band_sink& green, band_sink& blue);
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	band_sink* m_sinks[3];
+	band_image m_band;
+};
+
+// Hands every band to each of several sinks
+class tee_stage : public band_sink
+{
+public:
+	explicit tee_stage(const std::vector <band_sink*>& sinks);
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	std::vector <band_sink*> m_sinks;
+};
+
+// Absolute difference to a reference image of the same size, for comparing a result against its source
+class difference_stage : public band_stage
+{
+public:
+	difference_stage(band_sink& next, const band_image& reference);
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	const band_image& m_reference;
+	band_image m_band;
+};
+
+// Runs the sink on a thread of its own. push copies the band into a queue of at most
+// `depth` bands and returns, so a slow encoder only holds up the producer when it falls
+// that far behind. Band buffers are recycled, the queue allocates nothing once warm.
+class async_sink : public band_sink
+{
+public:
+	explicit async_sink(band_sink& target, int depth = 4);
+	~async_sink() override;
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	void worker();
+	void stop();
+
+	band_sink& m_target;
+	int m_depth;
+	std::thread m_thread;
+	std::mutex m_mutex;
+	std::condition_variable m_changed;
+	std::deque <std::pair <band_image, int>> m_queue;
+	std::vector <band_image> m_free;
+	bool m_closing;
+};
+
+// Writes the bands into a 24 bit bitmap as they arrive
+class bmp_band_writer : public band_sink
+{
+public:
+	explicit bmp_band_writer(const char* path, size_t buffer_size = 1 << 20);
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	const char* m_path;
+	size_t m_buffer_size;
+	bmp_writer m_writer;
+};
+
+// One "r g b" line of 0 - 255 values per pixel, for debugging
+class text_dump_sink : public band_sink
+{
+public:
+	explicit text_dump_sink(const char* path);
+	~text_dump_sink() override;
+
+	bool begin(int width, int height) override;
+	void push(const band_image& band, int first_row) override;
+	bool finish() override;
+
+private:
+	const char* m_path;
+	std::FILE* m_file;
+	std::vector <char> m_buffer;
+};
+
+// Reads a bitmap band by band and pushes it into sink
+bool stream_bmp(const char* path, band_sink& sink, int band_height = 64);
+
+// Pushes an image that is already in memory into sink band by band
+bool stream_image(const band_image& image, band_sink& sink, int band_height = 64);
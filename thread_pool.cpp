@@ -0,0 +1,187 @@
+#include "thread_pool.h"
+#include "profile.h"
+#include <algorithm>
+#include <memory>
+
+// set on pool threads so nested parallel loops run inline instead of deadlocking
+static thread_local bool inside_pool = false;
+
+thread_pool::thread_pool(int threads)
+{
+	if (threads <= 0)
+	{
+		threads = std::max(1, (int)std::thread::hardware_concurrency());
+	}
+
+	m_task = nullptr;
+	m_count = 0;
+	m_next = 0;
+	m_busy = 0;
+	m_generation = 0;
+	m_stop = false;
+
+	// the calling thread is the last worker
+	for (int i = 1; i < threads; i++)
+	{
+		m_workers.emplace_back(&thread_pool::worker, this);
+	}
+}
+
+thread_pool::~thread_pool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+	for (std::thread& t : m_workers)
+	{
+		t.join();
+	}
+}
+
+int thread_pool::size() const
+{
+	return (int)m_workers.size() + 1;
+}
+
+void thread_pool::run_items(const std::function<void(int)>& task, int count)
+{
+	PROFILE_SCOPE("pool work"); // per thread, so the report shows how evenly the work was split
+	for (int i = m_next++; i < count; i = m_next++)
+	{
+		task(i);
+	}
+}
+
+void thread_pool::worker()
+{
+	inside_pool = true;
+	unsigned seen = 0;
+	for (;;)
+	{
+		const std::function<void(int)>* task;
+		int count;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+			if (m_stop)
+			{
+				return;
+			}
+			seen = m_generation;
+			task = m_task;
+			count = m_count;
+			if (task == nullptr)
+			{
+				// woke up after the job was already finished
+				continue;
+			}
+			m_busy++;
+		}
+
+		run_items(*task, count);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_busy--;
+		}
+		m_done.notify_one();
+	}
+}
+
+void thread_pool::parallel_for(int count, const std::function<void(int)>& task)
+{
+	if (count <= 0)
+	{
+		return;
+	}
+	if (inside_pool || m_workers.empty() || count == 1)
+	{
+		for (int i = 0; i < count; i++)
+		{
+			task(i);
+		}
+		return;
+	}
+
+	// one job at a time when several threads share the pool
+	std::lock_guard<std::mutex> call(m_call_mutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	inside_pool = true;
+	run_items(task, count);
+	inside_pool = false;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&] { return m_busy == 0 && m_next >= m_count; });
+	m_task = nullptr;
+}
+
+static std::unique_ptr<thread_pool>& global_pool()
+{
+	static std::unique_ptr<thread_pool> pool;
+	return pool;
+}
+
+static std::mutex global_pool_mutex;
+
+thread_pool& thread_pool::global()
+{
+	std::lock_guard<std::mutex> lock(global_pool_mutex);
+	std::unique_ptr<thread_pool>& pool = global_pool();
+	if (!pool)
+	{
+		pool = std::make_unique<thread_pool>();
+	}
+	return *pool;
+}
+
+void thread_pool::set_thread_count(int threads)
+{
+	std::lock_guard<std::mutex> lock(global_pool_mutex);
+	global_pool() = std::make_unique<thread_pool>(threads);
+}
+
+void parallel_tiles(int width, int height, const std::function<void(const tile&)>& task, int tile_width, int tile_height)
+{
+	const int columns = (width + tile_width - 1) / tile_width;
+	const int rows = (height + tile_height - 1) / tile_height;
+
+	thread_pool::global().parallel_for(columns * rows, [&](int i)
+		{
+			tile t;
+			t.x0 = (i % columns) * tile_width;
+			t.y0 = (i / columns) * tile_height;
+			t.x1 = std::min(t.x0 + tile_width, width);
+			t.y1 = std::min(t.y0 + tile_height, height);
+			task(t);
+		});
+}
+
+void parallel_rows(int height, const std::function<void(int first, int last)>& task, int band_height)
+{
+	const int bands = (height + band_height - 1) / band_height;
+
+	thread_pool::global().parallel_for(bands, [&](int i)
+		{
+			task(i * band_height, std::min((i + 1) * band_height, height));
+		});
+}
+
+float* thread_scratch(size_t size)
+{
+	static thread_local std::vector <float> scratch;
+	if (scratch.size() < size)
+	{
+		scratch.resize(size);
+	}
+	return scratch.data();
+}
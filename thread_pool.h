@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads that split a range of independent items between them.
+// Items are handed out one at a time from a shared counter, so fast threads simply take
+// more of them. Every item writes its own part of the output, so the result does not
+// depend on which thread ran it.
+class thread_pool
+{
+public:
+	explicit thread_pool(int threads = 0); // 0 = one per hardware thread
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator =(const thread_pool&) = delete;
+	~thread_pool();
+
+	int size() const;
+
+	// runs task(i) for every i in [0, count) and returns when all are done
+	void parallel_for(int count, const std::function<void(int)>& task);
+
+	static thread_pool& global();
+	static void set_thread_count(int threads); // recreates the global pool, 0 = hardware threads
+
+private:
+	void worker();
+	void run_items(const std::function<void(int)>& task, int count);
+
+	std::vector <std::thread> m_workers;
+	std::mutex m_call_mutex;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_done;
+	const std::function<void(int)>* m_task;
+	int m_count;
+	std::atomic <int> m_next;
+	int m_busy;
+	unsigned m_generation;
+	bool m_stop;
+};
+
+// Rectangle of output pixels [x0, x1) x [y0, y1)
+struct tile
+{
+	int x0, y0, x1, y1;
+};
+
+// Splits an output of width x height into tiles of about one L2 cache worth of pixels
+void parallel_tiles(int width, int height, const std::function<void(const tile&)>& task, int tile_width = 128, int tile_height = 64);
+
+// Splits rows [0, height) into bands for loops that walk whole rows
+void parallel_rows(int height, const std::function<void(int first, int last)>& task, int band_height = 16);
+
+// Buffer of at least size floats owned by the calling thread and kept for its later calls, so
+// band loops take their row buffers here and allocate nothing once warmed up. One user per
+// thread at a time: nothing that runs while it is held may ask for it again.
+float* thread_scratch(size_t size);
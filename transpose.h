@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+// Cache oblivious transpose: the larger side is halved until the block fits in L1,
+// so both the reads and the writes stay inside a few pages whatever the image size.
+// Positions are in samples, an element is N consecutive samples (3 for interleaved pixels).
+// dst(j, i) = src(i, j) where src(i, j) = src[i * src_row + j * src_col].
+template <typename T, int N = 1>
+void transpose_block(const T* src, ptrdiff_t src_row, ptrdiff_t src_col,
+	T* dst, ptrdiff_t dst_row, ptrdiff_t dst_col, int rows, int columns)
+{
+	const int leaf = 32;
+
+	if (rows <= leaf && columns <= leaf)
+	{
+		for (int i = 0; i < rows; i++)
+		{
+			const T* in = src + i * src_row;
+			T* out = dst + i * dst_col;
+			for (int j = 0; j < columns; j++)
+			{
+				for (int k = 0; k < N; k++)
+				{
+					out[j * dst_row + k] = in[j * src_col + k];
+				}
+			}
+		}
+		return;
+	}
+
+	if (rows >= columns)
+	{
+		const int half = rows / 2;
+		transpose_block<T, N>(src, src_row, src_col, dst, dst_row, dst_col, half, columns);
+		transpose_block<T, N>(src + half * src_row, src_row, src_col, dst + half * dst_col, dst_row, dst_col, rows - half, columns);
+	}
+	else
+	{
+		const int half = columns / 2;
+		transpose_block<T, N>(src, src_row, src_col, dst, dst_row, dst_col, rows, half);
+		transpose_block<T, N>(src + half * src_col, src_row, src_col, dst + half * dst_row, dst_row, dst_col, rows, columns - half);
+	}
+}
+
+// Out of place transpose of a dense rows x columns array with N samples per element
+template <typename T, int N = 1>
+void transpose(const T* src, T* dst, int rows, int columns)
+{
+	transpose_block<T, N>(src, (ptrdiff_t)columns * N, N, dst, (ptrdiff_t)rows * N, N, rows, columns);
+}
+
+// Swaps a rows x columns block a with the columns x rows block b, transposing both
+template <typename T>
+void swap_transposed(T* a, T* b, ptrdiff_t stride, int rows, int columns)
+{
+	const int leaf = 32;
+
+	if (rows <= leaf && columns <= leaf)
+	{
+		for (int i = 0; i < rows; i++)
+		{
+			for (int j = 0; j < columns; j++)
+			{
+				std::swap(a[i * stride + j], b[j * stride + i]);
+			}
+		}
+		return;
+	}
+
+	if (rows >= columns)
+	{
+		const int half = rows / 2;
+		swap_transposed(a, b, stride, half, columns);
+		swap_transposed(a + half * stride, b + half, stride, rows - half, columns);
+	}
+	else
+	{
+		const int half = columns / 2;
+		swap_transposed(a, b, stride, rows, half);
+		swap_transposed(a + half, b + half * stride, stride, rows, columns - half);
+	}
+}
+
+// In place transpose of the n x n block starting at (first, first), swaps the blocks on both sides of the diagonal
+template <typename T>
+void transpose_diagonal_block(T* data, ptrdiff_t stride, int first, int n)
+{
+	const int leaf = 32;
+
+	if (n <= leaf)
+	{
+		for (int i = first; i < first + n; i++)
+		{
+			for (int j = i + 1; j < first + n; j++)
+			{
+				std::swap(data[i * stride + j], data[j * stride + i]);
+			}
+		}
+		return;
+	}
+
+	const int half = n / 2;
+	transpose_diagonal_block(data, stride, first, half);
+	transpose_diagonal_block(data, stride, first + half, n - half);
+
+	// off diagonal block [first, first + half) x [first + half, first + n) against its mirror
+	T* upper = data + first * stride + first + half;
+	T* lower = data + (first + half) * stride + first;
+	swap_transposed(upper, lower, stride, half, n - half);
+}
+
+// In place transpose of a dense n x n array
+template <typename T>
+void transpose_in_place(T* data, int n)
+{
+	transpose_diagonal_block(data, n, 0, n);
+}
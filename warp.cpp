@@ -0,0 +1,239 @@
+#include "warp.h"
+
+// Catmull-Rom and tent weights, without going through kernel_value for every tap
+static inline float filter_weight(rotate_filter filter, double d)
+{
+	d = std::fabs(d);
+	if (filter == rotate_filter::bilinear)
+	{
+		return d < 1.0 ? (float)(1.0 - d) : 0.0f;
+	}
+	if (d < 1.0)
+	{
+		return (float)((1.5 * d - 2.5) * d * d + 1.0);
+	}
+	if (d < 2.0)
+	{
+		return (float)(((-0.5 * d + 2.5) * d - 4.0) * d + 2.0);
+	}
+	return 0.0f;
+}
+
+// Index of tap i of an axis of `size` pixels, false when a constant border takes its place
+static inline bool map_tap(int& i, int size, border_mode border)
+{
+	if (i >= 0 && i < size)
+	{
+		return true;
+	}
+	switch (border)
+	{
+	case border_mode::clamp:
+		i = std::clamp(i, 0, size - 1);
+		return true;
+	case border_mode::reflect:
+		i = mirror_index(i, size);
+		return true;
+	default:
+		i = std::clamp(i, 0, size - 1);
+		return false;
+	}
+}
+
+void filter_taps::compute(double fx, double fy, rotate_filter filter, double footprint, int width, int height, border_mode border)
+{
+	if (filter == rotate_filter::nearest)
+	{
+		count_x = count_y = 1;
+		x[0] = (int)std::floor(fx + 0.5);
+		y[0] = (int)std::floor(fy + 0.5);
+		const bool in_x = map_tap(x[0], width, border), in_y = map_tap(y[0], height, border);
+		wx[0] = wy[0] = 1.0f;
+		inside = in_x && in_y ? 1.0f : 0.0f;
+		return;
+	}
+
+	// 16 taps on each axis at most, wider footprints alias a little instead
+	const double base = filter == rotate_filter::bilinear ? 1.0 : 2.0;
+	footprint = std::min(footprint, 7.5 / base);
+	const double radius = base * footprint;
+	const int x0 = (int)std::ceil(fx - radius), y0 = (int)std::ceil(fy - radius);
+	count_x = std::min((int)std::floor(fx + radius) - x0 + 1, 16);
+	count_y = std::min((int)std::floor(fy + radius) - y0 + 1, 16);
+
+	float sum_x = 0.0f, sum_y = 0.0f;
+	for (int k = 0; k < count_x; k++)
+	{
+		wx[k] = filter_weight(filter, (x0 + k - fx) / footprint);
+		sum_x += wx[k];
+	}
+	for (int k = 0; k < count_y; k++)
+	{
+		wy[k] = filter_weight(filter, (y0 + k - fy) / footprint);
+		sum_y += wy[k];
+	}
+
+	// normalised over all taps, the share of those a constant border replaces is left out
+	float in_x = 0.0f, in_y = 0.0f;
+	for (int k = 0; k < count_x; k++)
+	{
+		x[k] = x0 + k;
+		wx[k] = map_tap(x[k], width, border) ? wx[k] / sum_x : 0.0f;
+		in_x += wx[k];
+	}
+	for (int k = 0; k < count_y; k++)
+	{
+		y[k] = y0 + k;
+		wy[k] = map_tap(y[k], height, border) ? wy[k] / sum_y : 0.0f;
+		in_y += wy[k];
+	}
+	inside = in_x * in_y;
+}
+
+affine_transform affine_transform::scale(double sx, double sy)
+{
+	affine_transform t;
+	t.m[0][0] = sx;
+	t.m[1][1] = sy;
+	return t;
+}
+
+affine_transform affine_transform::rotation(const rotation_frame& frame)
+{
+	// the output point plus the canvas corner minx, miny, turned back by the angle. On continuous
+	// coordinates, so the corners of the source land on the edges of the canvas and quarter
+	// turns hit pixel centres exactly
+	const double c = frame.cosx, s = frame.sinx;
+	affine_transform t;
+	t.m[0][0] = c;
+	t.m[0][1] = s;
+	t.m[0][2] = frame.minx * c + frame.miny * s;
+	t.m[1][0] = -s;
+	t.m[1][1] = c;
+	t.m[1][2] = frame.miny * c - frame.minx * s;
+	return t;
+}
+
+affine_transform affine_transform::operator *(const affine_transform& inner) const
+{
+	affine_transform t;
+	for (int r = 0; r < 2; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			t.m[r][k] = m[r][0] * inner.m[0][k] + m[r][1] * inner.m[1][k] + (k == 2 ? m[r][2] : 0.0);
+		}
+	}
+	return t;
+}
+
+double affine_transform::footprint() const
+{
+	// lengths of the source steps of one output pixel right and one down
+	const double right = std::hypot(m[0][0], m[1][0]);
+	const double down = std::hypot(m[0][1], m[1][1]);
+	return std::max(1.0, std::max(right, down));
+}
+
+perspective_transform::perspective_transform(const affine_transform& affine)
+{
+	for (int r = 0; r < 2; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			m[r][k] = affine.m[r][k];
+		}
+	}
+}
+
+perspective_transform perspective_transform::quad(const double corners[8], int width, int height)
+{
+	// unit square onto the quadrilateral (Heckbert), then the output scaled onto the unit square
+	const double x0 = corners[0], y0 = corners[1], x1 = corners[2], y1 = corners[3];
+	const double x2 = corners[4], y2 = corners[5], x3 = corners[6], y3 = corners[7];
+	const double sum_x = x0 - x1 + x2 - x3, sum_y = y0 - y1 + y2 - y3;
+
+	double g = 0.0, h = 0.0;
+	if (sum_x != 0.0 || sum_y != 0.0)
+	{
+		const double dx1 = x1 - x2, dx2 = x3 - x2, dy1 = y1 - y2, dy2 = y3 - y2;
+		const double den = dx1 * dy2 - dx2 * dy1;
+		if (den != 0.0)
+		{
+			g = (sum_x * dy2 - dx2 * sum_y) / den;
+			h = (dx1 * sum_y - sum_x * dy1) / den;
+		}
+	}
+
+	perspective_transform t;
+	t.m[0][0] = (x1 - x0 + g * x1) / width;
+	t.m[0][1] = (x3 - x0 + h * x3) / height;
+	t.m[0][2] = x0;
+	t.m[1][0] = (y1 - y0 + g * y1) / width;
+	t.m[1][1] = (y3 - y0 + h * y3) / height;
+	t.m[1][2] = y0;
+	t.m[2][0] = g / width;
+	t.m[2][1] = h / height;
+	t.m[2][2] = 1.0;
+	return t;
+}
+
+bool perspective_transform::is_affine() const
+{
+	return m[2][0] == 0.0 && m[2][1] == 0.0 && m[2][2] == 1.0;
+}
+
+perspective_transform perspective_transform::operator *(const perspective_transform& inner) const
+{
+	perspective_transform t;
+	for (int r = 0; r < 3; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			t.m[r][k] = m[r][0] * inner.m[0][k] + m[r][1] * inner.m[1][k] + m[r][2] * inner.m[2][k];
+		}
+	}
+	return t;
+}
+
+perspective_transform perspective_transform::inverse() const
+{
+	// adjugate over the determinant
+	perspective_transform t;
+	for (int r = 0; r < 3; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			const int r1 = (k + 1) % 3, r2 = (k + 2) % 3, k1 = (r + 1) % 3, k2 = (r + 2) % 3;
+			t.m[r][k] = m[r1][k1] * m[r2][k2] - m[r1][k2] * m[r2][k1];
+		}
+	}
+	const double det = m[0][0] * t.m[0][0] + m[0][1] * t.m[1][0] + m[0][2] * t.m[2][0];
+	if (det == 0.0)
+	{
+		return perspective_transform();
+	}
+	for (int r = 0; r < 3; r++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			t.m[r][k] /= det;
+		}
+	}
+	return t;
+}
+
+double perspective_transform::footprint(double x, double y) const
+{
+	const double w = m[2][0] * x + m[2][1] * y + m[2][2];
+	if (w <= 0.0)
+	{
+		return 1.0;
+	}
+	// columns of the Jacobian of the map at x, y
+	const double sx = (m[0][0] * x + m[0][1] * y + m[0][2]) / w;
+	const double sy = (m[1][0] * x + m[1][1] * y + m[1][2]) / w;
+	const double right = std::hypot(m[0][0] - sx * m[2][0], m[1][0] - sy * m[2][0]) / w;
+	const double down = std::hypot(m[0][1] - sx * m[2][1], m[1][1] - sy * m[2][1]) / w;
+	return std::max(1.0, std::max(right, down));
+}
@@ -0,0 +1,440 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "image.h"
+#include "color.h"
+#include "rotate.h"
+#include "thread_pool.h"
+
+// Maps a point of the output to the point of the source it samples, in continuous pixel
+// coordinates (pixel x, y covers [x, x + 1) x [y, y + 1), its centre is at x + 0.5):
+//	source x = m[0][0] * x + m[0][1] * y + m[0][2]
+//	source y = m[1][0] * x + m[1][1] * y + m[1][2]
+struct affine_transform
+{
+	double m[2][3] = { { 1, 0, 0 }, { 0, 1, 0 } };
+
+	static affine_transform scale(double sx, double sy);
+	// output -> source of bitmap::rotate, the canvas of frame around the rotated source
+	static affine_transform rotation(const rotation_frame& frame);
+
+	// this after inner: the result maps through inner first
+	affine_transform operator *(const affine_transform& inner) const;
+
+	// how many source pixels one output pixel spans at most, 1 or more
+	double footprint() const;
+};
+
+// Output to source map of a homography, same coordinates as affine_transform:
+//	w = m[2][0] * x + m[2][1] * y + m[2][2]
+//	source x = (m[0][0] * x + m[0][1] * y + m[0][2]) / w
+//	source y = (m[1][0] * x + m[1][1] * y + m[1][2]) / w
+// Points with w <= 0 lie behind the horizon and take the border colour whatever the border mode.
+struct perspective_transform
+{
+	double m[3][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 } };
+
+	perspective_transform() = default;
+	perspective_transform(const affine_transform& affine);
+
+	// width x height output onto the source quadrilateral with corners top left, top right,
+	// bottom right, bottom left, as x y pairs: keystone and deskew correction of a scan
+	static perspective_transform quad(const double corners[8], int width, int height);
+
+	bool is_affine() const;
+
+	// this after inner, as for affine_transform
+	perspective_transform operator *(const perspective_transform& inner) const;
+
+	// the opposite map, for transforms known the other way round
+	perspective_transform inverse() const;
+
+	// how many source pixels the output pixel at x, y spans, 1 or more
+	double footprint(double x, double y) const;
+};
+
+// What the taps of a warp see outside the source
+enum class border_mode
+{
+	constant, // border_color
+	clamp, // the nearest edge pixel
+	reflect // mirrored at the edge pixels, without repeating them
+};
+
+struct warp_options
+{
+	rotate_filter filter = rotate_filter::bilinear;
+	border_mode border = border_mode::constant;
+	float border_color[3] = { 0.0f, 0.0f, 0.0f }; // 0 - 1 per channel
+};
+
+// Source pixels and weights of one output pixel, shared by its three channels. Weights are
+// normalised and positions mapped into the image by the border mode. With a constant border,
+// taps outside get no weight and `inside` is what is left for the source, the rest of the
+// pixel is border colour. Bilinear and bicubic widen their kernel by `footprint` so downscales
+// average instead of alias.
+struct filter_taps
+{
+	int count_x, count_y;
+	int x[16], y[16];
+	float wx[16], wy[16];
+	float inside;
+
+	void compute(double fx, double fy, rotate_filter filter, double footprint, int width, int height, border_mode border);
+};
+
+template <typename T, pixel_layout L>
+inline float sample_taps(const image<T, L>& src, const filter_taps& taps, int c)
+{
+	constexpr int stride = image<T, L>::pixel_stride;
+	const float scale = static_cast<float>(1.0 / sample_traits<T>::max_value);
+	float sum = 0.0f;
+	for (int j = 0; j < taps.count_y; j++)
+	{
+		const T* row = src.row(taps.y[j], c);
+		float line = 0.0f;
+		for (int k = 0; k < taps.count_x; k++)
+		{
+			line += taps.wx[k] * row[taps.x[k] * stride];
+		}
+		sum += taps.wy[j] * line;
+	}
+	return sum * scale;
+}
+
+// Source coordinate reflected into [0, size - 1] the way reflect mirrors pixel indices
+inline float reflect_coordinate(float s, int size)
+{
+	if (size == 1)
+	{
+		return 0.0f;
+	}
+	const float period = 2.0f * (size - 1);
+	s = std::fmod(std::fabs(s), period);
+	return s > size - 1 ? period - s : s;
+}
+
+// Taps of a filter on each side of the sample point, times the footprint for downscales
+inline double filter_radius(rotate_filter filter)
+{
+	switch (filter)
+	{
+	case rotate_filter::nearest:
+		return 0.5;
+	case rotate_filter::bilinear:
+		return 1.0;
+	default:
+		return 2.0;
+	}
+}
+
+// Pixel x of a warped row when none of its taps leave the source, the common case. ix, iy is
+// the source pixel at or left above the sample point, fx, fy the fraction past it.
+template <rotate_filter F, typename S, pixel_layout SL>
+inline void sample_interior(const image<S, SL>& src, int ix, int iy, float fx, float fy, float* const channel[3], int x)
+{
+	constexpr int stride = image<S, SL>::pixel_stride;
+	const float scale = static_cast<float>(1.0 / sample_traits<S>::max_value);
+	const ptrdiff_t pitch = static_cast<ptrdiff_t>(src.width()) * stride;
+
+	if constexpr (F == rotate_filter::nearest)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			channel[c][x] = src.row(iy, c)[ix * stride] * scale;
+		}
+	}
+	else if constexpr (F == rotate_filter::bilinear)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			const S* p = src.row(iy, c) + ix * stride;
+			const float top = p[0] + (p[stride] - (float)p[0]) * fx;
+			const float bottom = p[pitch] + (p[pitch + stride] - (float)p[pitch]) * fx;
+			channel[c][x] = (top + (bottom - top) * fy) * scale;
+		}
+	}
+	else
+	{
+		// Catmull-Rom weights of the four taps around the sample point
+		const float wx[4] = { ((-0.5f * fx + 1.0f) * fx - 0.5f) * fx, (1.5f * fx - 2.5f) * fx * fx + 1.0f, ((-1.5f * fx + 2.0f) * fx + 0.5f) * fx, (0.5f * fx - 0.5f) * fx * fx };
+		const float wy[4] = { ((-0.5f * fy + 1.0f) * fy - 0.5f) * fy, (1.5f * fy - 2.5f) * fy * fy + 1.0f, ((-1.5f * fy + 2.0f) * fy + 0.5f) * fy, (0.5f * fy - 0.5f) * fy * fy };
+		for (int c = 0; c < 3; c++)
+		{
+			const S* p = src.row(iy - 1, c) + (ix - 1) * stride;
+			float sum = 0.0f;
+			for (int j = 0; j < 4; j++, p += pitch)
+			{
+				sum += wy[j] * (wx[0] * p[0] + wx[1] * p[stride] + wx[2] * p[2 * stride] + wx[3] * p[3 * stride]);
+			}
+			channel[c][x] = sum * scale;
+		}
+	}
+}
+
+// Source x of an output point behind the horizon of a homography
+constexpr float behind_horizon = -1e9f;
+
+// Splits the source points of a row into the pixel at or before them and the fraction past
+// it, in one pass the compiler vectorises. Pixel centres are on whole numbers, nearest is
+// shifted by half a pixel so the whole part is the pixel it rounds to.
+template <rotate_filter F, typename S, pixel_layout SL>
+void split_points(const image<S, SL>& src, const float* sx, const float* sy, int* ix, int* iy, float* fx, float* fy, int width)
+{
+	const float margin = 32.0f;
+	const float right = src.width() - 1 + margin, bottom = src.height() - 1 + margin;
+	const float bias = F == rotate_filter::nearest ? 0.5f : 0.0f;
+
+	for (int x = 0; x < width; x++)
+	{
+		// far outside is as good as just outside, and keeps the int conversion in range
+		const float px = std::min(std::max(sx[x], -margin), right) + bias;
+		const float py = std::min(std::max(sy[x], -margin), bottom) + bias;
+		int i = (int)px, j = (int)py;
+		i -= px < i;
+		j -= py < j;
+		ix[x] = i;
+		iy[x] = j;
+		fx[x] = px - i;
+		fy[x] = py - j;
+	}
+}
+
+// Whether the fixed size kernel of F around pixel i, j of split_points stays inside the source
+template <rotate_filter F>
+inline bool taps_inside(int i, int j, int width, int height)
+{
+	constexpr int lo = F == rotate_filter::bicubic ? -1 : 0;
+	constexpr int hi = F == rotate_filter::nearest ? 0 : F == rotate_filter::bilinear ? 1 : 2;
+	return i + lo >= 0 && i + hi < width && j + lo >= 0 && j + hi < height;
+}
+
+// Colour at source point px, py near or past the edge, through the border mode
+template <rotate_filter F, typename S, pixel_layout SL>
+inline void sample_edge(const image<S, SL>& src, const warp_options& options, float px, float py, filter_taps& taps, float value[3])
+{
+	const float reach = (float)filter_radius(F);
+	if (options.border == border_mode::constant && (px <= -reach || py <= -reach || px >= src.width() - 1 + reach || py >= src.height() - 1 + reach))
+	{
+		std::copy(options.border_color, options.border_color + 3, value);
+		return;
+	}
+	taps.compute(px, py, F, 1.0, src.width(), src.height(), options.border);
+	for (int c = 0; c < 3; c++)
+	{
+		value[c] = sample_taps(src, taps, c) + (1.0f - taps.inside) * options.border_color[c];
+	}
+}
+
+// One output row of warp_image into float rows: interior pixels take the fixed size kernel of F,
+// pixels near or past the edge the general taps
+template <rotate_filter F, typename S, pixel_layout SL>
+void warp_row(const image<S, SL>& src, const warp_options& options, const float* sx, const float* sy, int* ix, int* iy, float* fx, float* fy, float* const channel[3], int width)
+{
+	split_points<F>(src, sx, sy, ix, iy, fx, fy, width);
+
+	const float bias = F == rotate_filter::nearest ? 0.5f : 0.0f;
+	filter_taps taps;
+	float value[3];
+	for (int x = 0; x < width; x++)
+	{
+		const int i = ix[x], j = iy[x];
+		if (taps_inside<F>(i, j, src.width(), src.height()))
+		{
+			sample_interior<F>(src, i, j, fx[x], fy[x], channel, x);
+			continue;
+		}
+		if (sx[x] == behind_horizon)
+		{
+			std::copy(options.border_color, options.border_color + 3, value);
+		}
+		else
+		{
+			sample_edge<F>(src, options, i + fx[x] - bias, j + fy[x] - bias, taps, value);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			channel[c][x] = value[c];
+		}
+	}
+}
+
+// Nearest warp_row straight into row y of dst, for warps without colour operations after them:
+// interior samples are copied without the round trip through floats
+template <typename S, pixel_layout SL, typename D, pixel_layout DL>
+void warp_row_copy(const image<S, SL>& src, image<D, DL>& dst, int y, const warp_options& options, const float* sx, const float* sy, int* ix, int* iy, float* fx, float* fy)
+{
+	const int width = dst.width();
+	split_points<rotate_filter::nearest>(src, sx, sy, ix, iy, fx, fy, width);
+
+	// the one tap of nearest is either inside or all border
+	const D border[3] = { to_sample<D>(options.border_color[0]), to_sample<D>(options.border_color[1]), to_sample<D>(options.border_color[2]) };
+	const bool constant = options.border == border_mode::constant;
+
+	// byte stores may alias anything, plain pointers keep the image members out of the loop
+	constexpr int in_stride = image<S, SL>::pixel_stride, out_stride = image<D, DL>::pixel_stride;
+	const int src_width = src.width(), src_height = src.height();
+	const ptrdiff_t pitch = static_cast<ptrdiff_t>(src_width) * in_stride;
+	const S* in[3] = { src.row(0, 0), src.row(0, 1), src.row(0, 2) };
+	D* out[3] = { dst.row(y, 0), dst.row(y, 1), dst.row(y, 2) };
+
+	filter_taps taps;
+	float value[3];
+	for (int x = 0; x < width; x++)
+	{
+		const int i = ix[x], j = iy[x];
+		if (taps_inside<rotate_filter::nearest>(i, j, src_width, src_height))
+		{
+			const ptrdiff_t at = j * pitch + i * in_stride;
+			for (int c = 0; c < 3; c++)
+			{
+				out[c][x * out_stride] = convert_sample<D>(in[c][at]);
+			}
+			continue;
+		}
+		const bool border_only = constant || sx[x] == behind_horizon;
+		if (!border_only)
+		{
+			sample_edge<rotate_filter::nearest>(src, options, i + fx[x] - 0.5f, j + fy[x] - 0.5f, taps, value);
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			out[c][x * out_stride] = border_only ? border[c] : to_sample<D>(value[c]);
+		}
+	}
+}
+
+// Point operation of a warp that has none
+struct no_point_op
+{
+	void operator ()(float*, float*, float*, int) const {}
+};
+
+// Resamples src into dst (already sized) through a map of output to source points, affine or
+// perspective. Each row starts at one transformed point and steps by constant increments, a
+// homography divides by its own stepped w. Rows are spread over the thread pool. Taps past the
+// edge of the source follow options.border. Each finished row goes through
+// point_op(r, g, b, width) on floats before it is stored, so colour operations after the warp
+// cost no extra pass over the image.
+template <typename S, pixel_layout SL, typename D, pixel_layout DL, typename F>
+void warp_image(const image<S, SL>& src, image<D, DL>& dst, const perspective_transform& to_source, const warp_options& options, const F& point_op)
+{
+	const int width = dst.width();
+	const bool affine = to_source.is_affine();
+	const double (&m)[3][3] = to_source.m;
+
+	parallel_rows(dst.height(), [&](int first, int last)
+		{
+			std::vector <float> rows(static_cast<size_t>(width) * 7);
+			float* channel[3] = { rows.data(), rows.data() + width, rows.data() + 2 * width };
+			float* sx = rows.data() + 3 * width;
+			float* sy = sx + width;
+			float* fx = sy + width;
+			float* fy = fx + width;
+			std::vector <int> whole(static_cast<size_t>(width) * 2);
+			int* ix = whole.data();
+			int* iy = ix + width;
+			filter_taps taps;
+
+			for (int y = first; y < last; y++)
+			{
+				// point of the centre of pixel 0 and its step to the next pixel
+				const double cy = y + 0.5;
+				const double x0 = m[0][0] * 0.5 + m[0][1] * cy + m[0][2];
+				const double y0 = m[1][0] * 0.5 + m[1][1] * cy + m[1][2];
+				const double w0 = m[2][0] * 0.5 + m[2][1] * cy + m[2][2];
+				const double step_x = m[0][0], step_y = m[1][0], step_w = m[2][0];
+
+				// -0.5 puts pixel centres on whole numbers
+				if (affine)
+				{
+					// float steps where the old rotate_image stepped in 32.32 fixed point, so the loop
+					// vectorises. Rounding is about 3 * 2^-24 of the coordinate, under two thousandths
+					// of a pixel for sources up to 8192 pixels across, and grows with larger ones
+					const float start_x = (float)(x0 - 0.5), start_y = (float)(y0 - 0.5);
+					const float dx = (float)step_x, dy = (float)step_y;
+					for (int x = 0; x < width; x++)
+					{
+						sx[x] = start_x + x * dx;
+						sy[x] = start_y + x * dy;
+					}
+				}
+				else
+				{
+					for (int x = 0; x < width; x++)
+					{
+						const double w = w0 + x * step_w;
+						const bool visible = w > 1e-12;
+						const double inverse = visible ? 1.0 / w : 0.0;
+						sx[x] = visible ? (float)((x0 + x * step_x) * inverse - 0.5) : behind_horizon;
+						sy[x] = visible ? (float)((y0 + x * step_y) * inverse - 0.5) : behind_horizon;
+					}
+				}
+
+				if (options.border == border_mode::reflect)
+				{
+					for (int x = 0; x < width; x++)
+					{
+						if (sx[x] != behind_horizon)
+						{
+							sx[x] = reflect_coordinate(sx[x], src.width());
+							sy[x] = reflect_coordinate(sy[x], src.height());
+						}
+					}
+				}
+
+				// rows that shrink need kernels wider than the fixed size ones, up to a quarter the
+				// aliasing is too faint to pay for them
+				const double footprint = affine ? to_source.footprint(0.0, 0.0) : std::max(to_source.footprint(0.5, cy), to_source.footprint(width - 0.5, cy));
+				if (footprint > 1.25 && options.filter != rotate_filter::nearest)
+				{
+					const double reach = filter_radius(options.filter) * footprint;
+					for (int x = 0; x < width; x++)
+					{
+						const double local = affine ? footprint : to_source.footprint(x + 0.5, cy);
+						if (sx[x] == behind_horizon || (options.border == border_mode::constant && (sx[x] <= -reach || sy[x] <= -reach || sx[x] >= src.width() - 1 + reach || sy[x] >= src.height() - 1 + reach)))
+						{
+							for (int c = 0; c < 3; c++)
+							{
+								channel[c][x] = options.border_color[c];
+							}
+							continue;
+						}
+						taps.compute(std::clamp(sx[x], -64.0f, src.width() + 64.0f), std::clamp(sy[x], -64.0f, src.height() + 64.0f), options.filter, local, src.width(), src.height(), options.border);
+						for (int c = 0; c < 3; c++)
+						{
+							channel[c][x] = sample_taps(src, taps, c) + (1.0f - taps.inside) * options.border_color[c];
+						}
+					}
+				}
+				else if (options.filter == rotate_filter::nearest)
+				{
+					if constexpr (std::is_same<F, no_point_op>::value)
+					{
+						warp_row_copy(src, dst, y, options, sx, sy, ix, iy, fx, fy);
+						continue;
+					}
+					warp_row<rotate_filter::nearest>(src, options, sx, sy, ix, iy, fx, fy, channel, width);
+				}
+				else if (options.filter == rotate_filter::bilinear)
+				{
+					warp_row<rotate_filter::bilinear>(src, options, sx, sy, ix, iy, fx, fy, channel, width);
+				}
+				else
+				{
+					warp_row<rotate_filter::bicubic>(src, options, sx, sy, ix, iy, fx, fy, channel, width);
+				}
+
+				point_op(channel[0], channel[1], channel[2], width);
+				store_pixels(channel, dst, y);
+			}
+		});
+}
+
+template <typename S, pixel_layout SL, typename D, pixel_layout DL>
+void warp_image(const image<S, SL>& src, image<D, DL>& dst, const perspective_transform& to_source, const warp_options& options)
+{
+	warp_image(src, dst, to_source, options, no_point_op());
+}